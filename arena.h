@@ -0,0 +1,79 @@
+/*
+    Borg ER-3
+
+    Bump allocator for the render and export buffers.
+
+    The block is sized when a render starts: it grows for
+    longer banks and shrinks back when a bank needs less
+    than half of it. Allocations are dropped all at once
+    by arenaReset, or back to a mark for scratch space,
+    so no large buffer has to live on the stack.
+*/
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <SDL2/SDL.h>
+
+#define ARENA_ALIGN 32
+
+struct sarena
+{
+    Uint8* base;
+    size_t size;
+    size_t used;
+};
+
+// block
+int  arenaReset(struct sarena* a, size_t bytes); // drops every allocation, -1 if the block could not be sized
+void arenaFree(struct sarena* a);
+
+// allocations
+void*  arenaAlloc(struct sarena* a, size_t bytes); // ARENA_ALIGN aligned, NULL when full
+size_t arenaMark(const struct sarena* a);
+void   arenaRelease(struct sarena* a, size_t mark); // drops everything allocated after mark
+
+/*
+    functions bodies
+*/
+
+int arenaReset(struct sarena* a, size_t bytes)
+{
+    a->used = 0;
+    bytes += ARENA_ALIGN;
+    if(a->base != NULL && bytes <= a->size && bytes >= a->size/2)
+        return 1;
+
+    free(a->base);
+    a->base = malloc(bytes);
+    a->size = a->base == NULL ? 0 : bytes;
+    return a->base == NULL ? -1 : 1;
+}
+
+void arenaFree(struct sarena* a)
+{
+    free(a->base);
+    memset(a, 0x00, sizeof(struct sarena));
+}
+
+void* arenaAlloc(struct sarena* a, size_t bytes)
+{
+    const uintptr_t p = ((uintptr_t)a->base + a->used + (ARENA_ALIGN-1)) & ~(uintptr_t)(ARENA_ALIGN-1);
+    const size_t end = (p - (uintptr_t)a->base) + bytes;
+    if(a->base == NULL || end > a->size)
+        return NULL;
+    a->used = end;
+    return (void*)p;
+}
+
+size_t arenaMark(const struct sarena* a)
+{
+    return a->used;
+}
+
+void arenaRelease(struct sarena* a, size_t mark)
+{
+    if(mark < a->used)
+        a->used = mark;
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*
+    Borg ER-3
+
+    Biquad cascade in transposed direct form II.
+
+    The active stages are packed into the lanes of one
+    vector and pipelined, lane k filters the sample that
+    lane k-1 produced on the previous step, so the whole
+    cascade costs one vector update per sample. Every block
+    starts and ends with a few masked steps while the
+    pipeline fills and drains, so no latency is added and
+    the stage states carry over from block to block.
+
+    Only stages with a coefficient outside +/-0.01 are run,
+    they are resolved by biquadsSet once per render, or
+    once per block when the coefficients are modulated.
+*/
+#ifndef BIQUAD_H
+#define BIQUAD_H
+
+#include <SDL2/SDL.h>
+#include <math.h>
+#ifdef __SSE__
+    #include <xmmintrin.h>
+#endif
+
+#define BIQUAD_STAGES 3
+#define BIQUAD_TINY   1e-15f // states below this are flushed after every block
+
+typedef float v4f __attribute__ ((vector_size (16)));
+typedef int   v4i __attribute__ ((vector_size (16)));
+
+struct sbiquads
+{
+    float s1[BIQUAD_STAGES];    // states of every stage, active or not
+    float s2[BIQUAD_STAGES];
+    v4f b0, b1, b2, a1, a2;     // coefficients of the active stages, one per lane
+    Uint32 stage[4];            // stage of each lane
+    Uint32 active;              // number of active stages
+};
+
+// state
+void biquadsReset(struct sbiquads* q);
+void biquadsSet(struct sbiquads* q, const float* c); // BIQUAD_STAGES x {b0, b1, b2, a1, a2}
+
+// process
+void biquadsProcess(struct sbiquads* q, float* x, Uint32 n); // in place
+void flushDenormals(); // for the calling thread
+
+/*
+    functions bodies
+*/
+
+void biquadsReset(struct sbiquads* q)
+{
+    memset(q, 0x00, sizeof(struct sbiquads));
+}
+
+void biquadsSet(struct sbiquads* q, const float* c)
+{
+    q->active = 0;
+    q->b0 = q->b1 = q->b2 = q->a1 = q->a2 = (v4f){0.f};
+    for(Uint32 i = 0; i < BIQUAD_STAGES; i++)
+    {
+        const float* s = &c[i*5];
+        Uint8 on = 0;
+        for(int j = 0; j < 5; j++)
+            if(s[j] <= -0.01f || s[j] >= 0.01f)
+                on = 1;
+        if(on == 0)
+            continue;
+
+        const Uint32 l = q->active;
+        q->b0[l] = s[0];
+        q->b1[l] = s[1];
+        q->b2[l] = s[2];
+        q->a1[l] = s[3];
+        q->a2[l] = s[4];
+        q->stage[l] = i;
+        q->active++;
+    }
+}
+
+void biquadsProcess(struct sbiquads* q, float* x, Uint32 n)
+{
+    const Uint32 act = q->active;
+    if(act == 0 || n == 0)
+        return;
+    const Uint32 lat = act - 1;
+
+    // gather the states of the active stages
+    v4f s1 = {0.f}, s2 = {0.f}, y = {0.f};
+    for(Uint32 l = 0; l < act; l++)
+    {
+        s1[l] = q->s1[q->stage[l]];
+        s2[l] = q->s2[q->stage[l]];
+    }
+
+    const v4i lane = {0, 1, 2, 3};
+    for(Uint32 t = 0; t < n + lat; t++)
+    {
+        const v4f in = {t < n ? x[t] : 0.f, y[0], y[1], y[2]};
+        const v4f yn = q->b0 * in + s1;
+        const v4f s1n = q->b1 * in - q->a1 * yn + s2;
+        const v4f s2n = q->b2 * in - q->a2 * yn;
+
+        if(t >= lat && t < n)
+        {
+            y = yn;
+            s1 = s1n;
+            s2 = s2n;
+        }
+        else
+        {
+            // filling or draining, lane l only runs on samples 0 to n-1
+            const v4i m = (lane <= (int)t) & (lane + (int)n > (int)t);
+            y = (v4f)(((v4i)yn & m) | ((v4i)y & ~m));
+            s1 = (v4f)(((v4i)s1n & m) | ((v4i)s1 & ~m));
+            s2 = (v4f)(((v4i)s2n & m) | ((v4i)s2 & ~m));
+        }
+
+        if(t >= lat)
+            x[t - lat] = y[lat];
+    }
+
+    // scatter back, flushing decayed tails before they turn denormal
+    for(Uint32 l = 0; l < act; l++)
+    {
+        q->s1[q->stage[l]] = fabsf(s1[l]) < BIQUAD_TINY ? 0.f : s1[l];
+        q->s2[q->stage[l]] = fabsf(s2[l]) < BIQUAD_TINY ? 0.f : s2[l];
+    }
+}
+
+void flushDenormals()
+{
+#ifdef __SSE__
+    _mm_setcsr(_mm_getcsr() | 0x8040); // flush to zero, denormals are zero
+#endif
+}
+
+#endif
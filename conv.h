@@ -0,0 +1,177 @@
+/*
+    Borg ER-3
+
+    Uniformly partitioned FFT convolution (overlap-save)
+    used by the reverb stage.
+
+    The impulse response is cut into partitions of one
+    block each and transformed once, every processed block
+    costs one forward FFT, one inverse FFT and a complex
+    multiply-accumulate per partition, so the cost per block
+    stays bounded however long the impulse response is.
+
+    A struct simpulse is read-only once loaded and can be
+    shared by any number of struct sconv states.
+*/
+#ifndef CONV_H
+#define CONV_H
+
+#include <SDL2/SDL.h>
+#include "fft.h"
+
+struct simpulse
+{
+    Uint32 block;       // partition size
+    Uint32 parts;       // number of partitions
+    Uint32 bins;        // block+1
+    struct sfft fft;    // size block*2
+    float* re;          // parts*bins partition spectra
+    float* im;
+};
+
+struct sconv
+{
+    const struct simpulse* ir;
+    float* fdl_re;      // parts*bins frequency-domain delay line of input spectra
+    float* fdl_im;
+    Uint32 fdl_pos;
+    float* in;          // block*2, previous and current input block
+    float* acc_re;      // bins
+    float* acc_im;
+    float* out;         // block*2
+};
+
+// impulse
+int  impulseInit(struct simpulse* ir, const float* h, Uint32 len, Uint32 block);
+void impulseFree(struct simpulse* ir);
+
+// state
+int  convInit(struct sconv* c, const struct simpulse* ir);
+void convReset(struct sconv* c);
+void convFree(struct sconv* c);
+void convProcess(struct sconv* c, const float* in, float* out); // exactly ir->block samples
+
+/*
+    functions bodies
+*/
+
+int impulseInit(struct simpulse* ir, const float* h, Uint32 len, Uint32 block)
+{
+    memset(ir, 0x00, sizeof(struct simpulse));
+    if(len == 0 || fftInit(&ir->fft, block*2) < 0)
+        return -1;
+
+    ir->block = block;
+    ir->bins = block+1;
+    ir->parts = (len + block - 1) / block;
+    ir->re = malloc(ir->parts * ir->bins * sizeof(float));
+    ir->im = malloc(ir->parts * ir->bins * sizeof(float));
+    float* t = calloc(block*2, sizeof(float));
+    if(ir->re == NULL || ir->im == NULL || t == NULL)
+    {
+        free(t);
+        impulseFree(ir);
+        return -1;
+    }
+
+    // zero padded partition spectra
+    for(Uint32 p = 0; p < ir->parts; p++)
+    {
+        memset(t, 0x00, block*2*sizeof(float));
+        for(Uint32 i = 0; i < block && p*block+i < len; i++)
+            t[i] = h[p*block+i];
+        fftReal(&ir->fft, t, &ir->re[p*ir->bins], &ir->im[p*ir->bins]);
+    }
+
+    free(t);
+    return 1;
+}
+
+void impulseFree(struct simpulse* ir)
+{
+    fftFree(&ir->fft);
+    free(ir->re);
+    free(ir->im);
+    memset(ir, 0x00, sizeof(struct simpulse));
+}
+
+int convInit(struct sconv* c, const struct simpulse* ir)
+{
+    memset(c, 0x00, sizeof(struct sconv));
+    c->ir = ir;
+    c->fdl_re = malloc(ir->parts * ir->bins * sizeof(float));
+    c->fdl_im = malloc(ir->parts * ir->bins * sizeof(float));
+    c->in = malloc(ir->block * 2 * sizeof(float));
+    c->acc_re = malloc(ir->bins * sizeof(float));
+    c->acc_im = malloc(ir->bins * sizeof(float));
+    c->out = malloc(ir->block * 2 * sizeof(float));
+    if(c->fdl_re == NULL || c->fdl_im == NULL || c->in == NULL || c->acc_re == NULL || c->acc_im == NULL || c->out == NULL)
+    {
+        convFree(c);
+        return -1;
+    }
+    convReset(c);
+    return 1;
+}
+
+void convReset(struct sconv* c)
+{
+    memset(c->fdl_re, 0x00, c->ir->parts * c->ir->bins * sizeof(float));
+    memset(c->fdl_im, 0x00, c->ir->parts * c->ir->bins * sizeof(float));
+    memset(c->in, 0x00, c->ir->block * 2 * sizeof(float));
+    c->fdl_pos = 0;
+}
+
+void convFree(struct sconv* c)
+{
+    free(c->fdl_re);
+    free(c->fdl_im);
+    free(c->in);
+    free(c->acc_re);
+    free(c->acc_im);
+    free(c->out);
+    memset(c, 0x00, sizeof(struct sconv));
+}
+
+void convProcess(struct sconv* c, const float* in, float* out)
+{
+    const struct simpulse* ir = c->ir;
+    const Uint32 block = ir->block;
+    const Uint32 bins = ir->bins;
+
+    // slide the input window and transform it into the newest delay line slot
+    memcpy(c->in, c->in + block, block*sizeof(float));
+    memcpy(c->in + block, in, block*sizeof(float));
+    c->fdl_pos = c->fdl_pos == 0 ? ir->parts-1 : c->fdl_pos-1;
+    float* xr = &c->fdl_re[c->fdl_pos*bins];
+    float* xi = &c->fdl_im[c->fdl_pos*bins];
+    fftReal(&ir->fft, c->in, xr, xi);
+
+    // multiply-accumulate every partition with its delayed input spectrum
+    float* restrict ar = c->acc_re;
+    float* restrict ai = c->acc_im;
+    memset(ar, 0x00, bins*sizeof(float));
+    memset(ai, 0x00, bins*sizeof(float));
+    Uint32 slot = c->fdl_pos;
+    for(Uint32 p = 0; p < ir->parts; p++)
+    {
+        const float* restrict hr = &ir->re[p*bins];
+        const float* restrict hi = &ir->im[p*bins];
+        const float* restrict sr = &c->fdl_re[slot*bins];
+        const float* restrict si = &c->fdl_im[slot*bins];
+        for(Uint32 k = 0; k < bins; k++)
+        {
+            ar[k] += sr[k]*hr[k] - si[k]*hi[k];
+            ai[k] += sr[k]*hi[k] + si[k]*hr[k];
+        }
+        slot++;
+        if(slot == ir->parts)
+            slot = 0;
+    }
+
+    // overlap-save: the last block of the circular result is valid
+    ifftReal(&ir->fft, ar, ai, c->out);
+    memcpy(out, c->out + block, block*sizeof(float));
+}
+
+#endif
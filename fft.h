@@ -0,0 +1,267 @@
+/*
+    Borg ER-3
+
+    Radix-2 FFT used by the additive (IFFT) oscillators.
+
+    The real transforms are computed with a half size
+    complex FFT, packing the even samples into the real
+    part and the odd samples into the imaginary part.
+
+    The butterflies of the stages 8 or more wide run 8 at
+    a time on GNU C vectors, the twiddles of each stage are
+    laid out contiguously for them in wc/ws.
+
+    A struct sfft only holds read-only tables once
+    initialised, so one can be shared between threads.
+*/
+#ifndef FFT_H
+#define FFT_H
+
+#include <SDL2/SDL.h>
+#include <math.h>
+#include "vec.h"
+
+#define FFT_LANES 8
+
+struct sfft
+{
+    Uint32 n;       // real transform size
+    Uint32 m;       // complex transform size (n/2)
+    Uint32* rev;    // bit reversal permutation of m
+    float* tc;      // cos(2pi k/m), k < m/2
+    float* ts;      // sin(2pi k/m)
+    float* rc;      // cos(2pi k/n), k <= m/2
+    float* rs;      // sin(2pi k/n)
+    float* wc;      // tc of the stage of width 2h at wc[h+j], j < h
+    float* ws;
+};
+
+// init
+int  fftInit(struct sfft* f, Uint32 n); // n must be a power of two >= 4
+void fftFree(struct sfft* f);
+
+// transforms
+void fftComplex(const struct sfft* f, float* re, float* im, int inverse); // unnormalised, size m
+void fftReal(const struct sfft* f, const float* in, float* re, float* im); // n samples in, m+1 bins out
+void ifftReal(const struct sfft* f, float* re, float* im, float* out);     // m+1 bins in (destroyed), n samples out
+
+/*
+    functions bodies
+*/
+
+int fftInit(struct sfft* f, Uint32 n)
+{
+    memset(f, 0x00, sizeof(struct sfft));
+    if(n < 4 || (n & (n-1)) != 0)
+        return -1;
+
+    f->n = n;
+    f->m = n/2;
+    f->rev = malloc(f->m * sizeof(Uint32));
+    f->tc = malloc((f->m/2) * sizeof(float));
+    f->ts = malloc((f->m/2) * sizeof(float));
+    f->rc = malloc((f->m/2+1) * sizeof(float));
+    f->rs = malloc((f->m/2+1) * sizeof(float));
+    f->wc = malloc(f->m * sizeof(float));
+    f->ws = malloc(f->m * sizeof(float));
+    if(f->rev == NULL || f->tc == NULL || f->ts == NULL || f->rc == NULL || f->rs == NULL || f->wc == NULL || f->ws == NULL)
+    {
+        fftFree(f);
+        return -1;
+    }
+
+    Uint32 bits = 0;
+    while((1u << bits) < f->m)
+        bits++;
+    for(Uint32 i = 0; i < f->m; i++)
+    {
+        Uint32 r = 0;
+        for(Uint32 b = 0; b < bits; b++)
+            r |= ((i >> b) & 1) << (bits-1-b);
+        f->rev[i] = r;
+    }
+
+    for(Uint32 k = 0; k < f->m/2; k++)
+    {
+        f->tc[k] = cos(6.283185307179586 * (double)k / (double)f->m);
+        f->ts[k] = sin(6.283185307179586 * (double)k / (double)f->m);
+    }
+
+    for(Uint32 k = 0; k <= f->m/2; k++)
+    {
+        f->rc[k] = cos(6.283185307179586 * (double)k / (double)f->n);
+        f->rs[k] = sin(6.283185307179586 * (double)k / (double)f->n);
+    }
+
+    // the same values as tc/ts, so both butterfly paths agree to the bit
+    for(Uint32 half = 1; half < f->m; half <<= 1)
+    {
+        const Uint32 step = f->m / (half*2);
+        for(Uint32 j = 0; j < half; j++)
+        {
+            f->wc[half+j] = f->tc[j*step];
+            f->ws[half+j] = f->ts[j*step];
+        }
+    }
+
+    return 1;
+}
+
+void fftFree(struct sfft* f)
+{
+    free(f->rev);
+    free(f->tc);
+    free(f->ts);
+    free(f->rc);
+    free(f->rs);
+    free(f->wc);
+    free(f->ws);
+    memset(f, 0x00, sizeof(struct sfft));
+}
+
+void fftComplex(const struct sfft* f, float* re, float* im, int inverse)
+{
+    const Uint32 m = f->m;
+
+    // bit reversal
+    for(Uint32 i = 0; i < m; i++)
+    {
+        const Uint32 r = f->rev[i];
+        if(r > i)
+        {
+            float t = re[i]; re[i] = re[r]; re[r] = t;
+            t = im[i]; im[i] = im[r]; im[r] = t;
+        }
+    }
+
+    // butterflies
+    const float sign = inverse == 1 ? 1.f : -1.f;
+    Uint32 len = 2;
+    for(; len <= m && len < FFT_LANES*2; len <<= 1)
+    {
+        const Uint32 half = len >> 1;
+        const Uint32 step = m / len;
+        for(Uint32 i = 0; i < m; i += len)
+        {
+            for(Uint32 j = 0; j < half; j++)
+            {
+                const float wr = f->tc[j*step];
+                const float wi = f->ts[j*step] * sign;
+                const Uint32 a = i+j, b = i+j+half;
+                const float vr = re[b]*wr - im[b]*wi;
+                const float vi = re[b]*wi + im[b]*wr;
+                re[b] = re[a] - vr;
+                im[b] = im[a] - vi;
+                re[a] += vr;
+                im[a] += vi;
+            }
+        }
+    }
+    for(; len <= m; len <<= 1)
+    {
+        const Uint32 half = len >> 1;
+        for(Uint32 i = 0; i < m; i += len)
+        {
+            for(Uint32 j = 0; j < half; j += FFT_LANES)
+            {
+                v8f wr, wi, ar, ai, br, bi;
+                memcpy(&wr, &f->wc[half+j], sizeof(v8f));
+                memcpy(&wi, &f->ws[half+j], sizeof(v8f));
+                memcpy(&ar, &re[i+j], sizeof(v8f));
+                memcpy(&ai, &im[i+j], sizeof(v8f));
+                memcpy(&br, &re[i+j+half], sizeof(v8f));
+                memcpy(&bi, &im[i+j+half], sizeof(v8f));
+                wi *= sign;
+                const v8f vr = br*wr - bi*wi;
+                const v8f vi = br*wi + bi*wr;
+                br = ar - vr;
+                bi = ai - vi;
+                ar += vr;
+                ai += vi;
+                memcpy(&re[i+j], &ar, sizeof(v8f));
+                memcpy(&im[i+j], &ai, sizeof(v8f));
+                memcpy(&re[i+j+half], &br, sizeof(v8f));
+                memcpy(&im[i+j+half], &bi, sizeof(v8f));
+            }
+        }
+    }
+}
+
+void fftReal(const struct sfft* f, const float* in, float* re, float* im)
+{
+    const Uint32 m = f->m;
+
+    // pack even/odd samples
+    for(Uint32 i = 0; i < m; i++)
+    {
+        re[i] = in[i*2];
+        im[i] = in[i*2+1];
+    }
+    fftComplex(f, re, im, 0);
+
+    // split into the real spectrum, pairs k and m-k at a time
+    const float z0r = re[0], z0i = im[0];
+    re[0] = z0r + z0i;
+    im[0] = 0.f;
+    re[m] = z0r - z0i;
+    im[m] = 0.f;
+    for(Uint32 k = 1; k <= m/2; k++)
+    {
+        const Uint32 j = m-k;
+        const float er = (re[k] + re[j]) * 0.5f;
+        const float ei = (im[k] - im[j]) * 0.5f;
+        const float orr = (im[k] + im[j]) * 0.5f;
+        const float oi = (re[j] - re[k]) * 0.5f;
+        const float wr = f->rc[k], wi = -f->rs[k]; // e^(-i2pi k/n)
+        const float tr = wr*orr - wi*oi;
+        const float ti = wr*oi + wi*orr;
+        re[k] = er + tr;
+        im[k] = ei + ti;
+        if(j != k)
+        {
+            // X[m-k] = conj(E) - e^(i2pi k/n) conj(O)
+            re[j] = er - (wr*orr - wi*oi);
+            im[j] = -ei + (wr*oi + wi*orr);
+        }
+    }
+}
+
+void ifftReal(const struct sfft* f, float* re, float* im, float* out)
+{
+    const Uint32 m = f->m;
+
+    // merge the real spectrum back into one complex spectrum of size m
+    const float x0 = re[0], xm = re[m];
+    re[0] = (x0 + xm) * 0.5f;
+    im[0] = (x0 - xm) * 0.5f;
+    for(Uint32 k = 1; k <= m/2; k++)
+    {
+        const Uint32 j = m-k;
+        const float er = (re[k] + re[j]) * 0.5f;
+        const float ei = (im[k] - im[j]) * 0.5f;
+        const float dr = (re[k] - re[j]) * 0.5f;
+        const float di = (im[k] + im[j]) * 0.5f;
+        const float wr = f->rc[k], wi = f->rs[k]; // e^(i2pi k/n)
+        const float orr = dr*wr - di*wi;
+        const float oi = dr*wi + di*wr;
+        re[k] = er - oi;
+        im[k] = ei + orr;
+        if(j != k)
+        {
+            // Z[m-k] = conj(E) + i conj(O)
+            re[j] = er + oi;
+            im[j] = -ei + orr;
+        }
+    }
+    fftComplex(f, re, im, 1);
+
+    // unpack even/odd samples
+    const float s = 1.f / (float)m;
+    for(Uint32 i = 0; i < m; i++)
+    {
+        out[i*2] = re[i] * s;
+        out[i*2+1] = im[i] * s;
+    }
+}
+
+#endif
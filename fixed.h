@@ -0,0 +1,203 @@
+/*
+    Borg ER-3
+
+    Integer DSP primitives for the fixed-point render path
+    (build with -DFIXED_POINT), aimed at small ARM boards
+    where float tanhf/expf/modff per sample is too slow.
+
+    Signals are Sint32 with 15 fractional bits where 1.0
+    is one 8-bit output step, so the 16 integer bits leave
+    headroom for the modulation products of the float path.
+    Oscillator phases are Uint32 where 2^32 is one cycle,
+    which lets the harmonic phases wrap for free.
+    Biquad coefficients are Q28 with 64-bit accumulation,
+    outputs saturate at +/-FX_MAX.
+*/
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <SDL2/SDL.h>
+#include <math.h>
+
+#define FX_ONE        32768
+#define FX_MAX        536870911 // keeps the biquad accumulators inside 64 bits
+#define FX_SINE_BITS  12
+#define FX_HARMONICS  64
+
+// tables
+Sint16 fx_sine[(1 << FX_SINE_BITS)+1]; // Q15 sine, +1 guard point
+Sint32 fx_inv[FX_HARMONICS+1];      // Q15 1/h
+Sint32 fx_inv2[FX_HARMONICS+1];     // Q15 1/h^2
+Sint32 fx_formant[FX_HARMONICS+1];  // Q15 exp(-((h-5)/2)^2)/h
+Sint32 fx_vamps[10];                // Q15 impulse amplitudes
+Sint32 fx_squish[1025];             // Q15 tanh over [0, 8)
+
+// init
+void initFixed();
+
+// utility functions
+Sint32 fxSat(Sint64 x);
+Sint32 fxMul(Sint32 a, Sint32 b);
+Sint32 fxSquish(Sint32 x);
+float  fxToFloat(Sint32 x);
+
+// generators, r is the Q15 resolution
+Sint32 fxSin(Uint32 phase);
+Sint32 fxSlantSine(Uint32 phase, Sint32 r);
+Sint32 fxSquare(Uint32 phase, Sint32 r);
+Sint32 fxSawtooth(Uint32 phase, Sint32 r);
+Sint32 fxTriangle(Uint32 phase, Sint32 r);
+Sint32 fxBipulse(Uint32 phase, Sint32 r);
+Sint32 fxViolin(Uint32 phase, Sint32 r);
+
+// biquad, c is {b1, b2, b3, a1, a2} in Q28
+struct sfxbiquad
+{
+    Sint32 x1, x2, y1, y2;
+};
+Sint32 fxBiquad(struct sfxbiquad* q, const Sint32* c, Sint32 x);
+
+/*
+    functions bodies
+*/
+
+void initFixed()
+{
+    for(int i = 0; i <= (1 << FX_SINE_BITS); i++)
+        fx_sine[i] = lrint(sin(6.283185307179586 * (double)i / (double)(1 << FX_SINE_BITS)) * 32767.0);
+
+    fx_inv[0] = fx_inv2[0] = fx_formant[0] = 0;
+    for(int h = 1; h <= FX_HARMONICS; h++)
+    {
+        const double d = (h - 5.0) * 0.5;
+        fx_inv[h] = lrint(32768.0 / h);
+        fx_inv2[h] = lrint(32768.0 / (h*h));
+        fx_formant[h] = lrint((exp(-d * d) / h) * 32768.0);
+    }
+
+    for(int h = 0; h < 10; h++)
+        fx_vamps[h] = lrint((0.5 - h * 0.05) * 32768.0);
+
+    for(int i = 0; i <= 1024; i++)
+        fx_squish[i] = lrint(tanh(i / 128.0) * 32768.0);
+}
+
+inline Sint32 fxSat(Sint64 x)
+{
+    if(x > FX_MAX)
+        return FX_MAX;
+    else if(x < -FX_MAX)
+        return -FX_MAX;
+    return x;
+}
+
+inline Sint32 fxMul(Sint32 a, Sint32 b)
+{
+    return fxSat(((Sint64)a * (Sint64)b) >> 15);
+}
+
+inline Sint32 fxSquish(Sint32 x)
+{
+    // |tanh(x)| linearly interpolated from a 1/128 step table
+    if(x < 0)
+        x = -x;
+    if(x >= 8 * FX_ONE)
+        return fx_squish[1024];
+    const Sint32 i = x >> 8;
+    const Sint32 fr = x & 255;
+    return fx_squish[i] + (((fx_squish[i+1] - fx_squish[i]) * fr) >> 8);
+}
+
+inline float fxToFloat(Sint32 x)
+{
+    return (float)x * (1.f / FX_ONE);
+}
+
+inline Sint32 fxSin(Uint32 phase)
+{
+    // linearly interpolated, the 15 phase bits below the index are the fraction
+    const Uint32 i = phase >> (32 - FX_SINE_BITS);
+    const Sint32 fr = (phase >> (17 - FX_SINE_BITS)) & (FX_ONE-1);
+    return fx_sine[i] + (((fx_sine[i+1] - fx_sine[i]) * fr) >> 15);
+}
+
+Sint32 fxSlantSine(Uint32 phase, Sint32 r)
+{
+    Sint32 yr = fxSin(phase);
+    for(Sint32 h = 3; (h << 15) < r && h <= FX_HARMONICS; h++)
+        yr += (fxSin(phase*h) * fx_inv2[h]) >> 15;
+    return yr;
+}
+
+Sint32 fxSquare(Uint32 phase, Sint32 r)
+{
+    r *= 2;
+    Sint32 yr = fxSin(phase);
+    for(Sint32 h = 3; (h << 15) < r && h <= FX_HARMONICS; h+=2)
+        yr += (fxSin(phase*h) * fx_inv[h]) >> 15;
+    return yr;
+}
+
+Sint32 fxSawtooth(Uint32 phase, Sint32 r)
+{
+    Sint32 yr = fxSin(phase);
+    for(Sint32 h = 2; (h << 15) <= r && h <= FX_HARMONICS; h++)
+        yr += (fxSin(phase*h) * fx_inv[h]) >> 15;
+    return yr;
+}
+
+Sint32 fxTriangle(Uint32 phase, Sint32 r)
+{
+    r *= 2;
+    Sint32 yr = fxSin(phase);
+    Sint32 sign = -1;
+    for(Sint32 h = 3; (h << 15) <= r && h <= FX_HARMONICS; h+=2)
+    {
+        yr += ((fxSin(phase*h) * fx_inv2[h]) >> 15) * sign;
+        sign = -sign;
+    }
+    return yr;
+}
+
+Sint32 fxBipulse(Uint32 phase, Sint32 r)
+{
+    Sint32 yr = 0;
+    for(Sint32 h = 1; (h << 15) <= r && h <= FX_HARMONICS; h++)
+        yr += (fxSin(phase*h) * fx_formant[h]) >> 15;
+    return yr;
+}
+
+Sint32 fxViolin(Uint32 phase, Sint32 r)
+{
+    Sint32 yr = 0;
+    for(Sint32 h = 0; h < 10; h++)
+    {
+        const Sint32 step = (h * 3) << 15;
+        if(r > step)
+        {
+            const Uint32 offset = (h % 2 == 0) ? 0 : 0x40000000; // quarter cycle
+            Sint32 amp = fx_vamps[h];
+            if(r < step + (3 << 15))
+                amp = (Sint32)(((Sint64)amp * (r - step)) / (3 << 15));
+            yr += (fxSin(phase * (h + 1) + offset) * amp) >> 15;
+        }
+    }
+    return yr;
+}
+
+Sint32 fxBiquad(struct sfxbiquad* q, const Sint32* c, Sint32 x)
+{
+    const Sint64 acc = (Sint64)c[0] * x
+                     + (Sint64)c[1] * q->x1
+                     + (Sint64)c[2] * q->x2
+                     - (Sint64)c[3] * q->y1
+                     - (Sint64)c[4] * q->y2;
+    const Sint32 y = fxSat(acc >> 28);
+    q->x2 = q->x1;
+    q->x1 = x;
+    q->y2 = q->y1;
+    q->y1 = y;
+    return y;
+}
+
+#endif
@@ -0,0 +1,732 @@
+/*
+    Borg ER-3
+
+    16-bit mono FLAC encoder.
+
+    Every FLAC_BLOCK samples become one frame with a single
+    subframe, whichever is smallest of constant, verbatim, the
+    fixed predictors of order 0 to 4 and LPC of order 4, 8 or
+    FLAC_MAX_LPC, with a partitioned Rice coded residual.
+    Frames are independent, so FLAC_BATCH of them are encoded
+    at once and written in order, by threads started with the
+    file and woken once per batch. STREAMINFO
+    is rewritten by flacClose with the frame sizes, length
+    and MD5 of the PCM once they are known.
+*/
+#ifndef FLAC_H
+#define FLAC_H
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <math.h>
+#include "arena.h"
+
+#define FLAC_BLOCK     4096
+#define FLAC_BATCH     16   // frames encoded in parallel
+#define FLAC_MAX_LPC   12
+#define FLAC_PRECISION 14   // bits of the quantised LPC coefficients
+#define FLAC_MAX_PART  8    // highest Rice partition order
+#define FLAC_FRAME_MAX (FLAC_BLOCK*4 + 64) // twice a verbatim frame
+#define FLAC_BUFFER    (FLAC_BATCH*(FLAC_BLOCK*2 + FLAC_FRAME_MAX + ARENA_ALIGN) + ARENA_ALIGN) // arena bytes of flacOpen
+
+struct smd5
+{
+    Uint32 h[4];
+    Uint8 buf[64];
+    Uint64 len;
+};
+
+struct sflac
+{
+    FILE* f;
+    Uint32 rate;
+    Sint16* pcm;                    // FLAC_BATCH*FLAC_BLOCK samples waiting
+    Uint32 fill;
+    Uint8* frame[FLAC_BATCH];       // encoded frames, FLAC_FRAME_MAX each
+    Uint32 frame_len[FLAC_BATCH];
+    Uint32 frames;                  // frames written
+    Uint64 len;                     // samples written
+    Uint64 bytes;                   // file size so far
+    Uint32 min_frame, max_frame;
+    struct smd5 md5;
+    struct sarena* arena;
+    size_t mark;
+    int err;
+    SDL_Thread* worker[FLAC_BATCH]; // encode with the writing thread
+    Uint32 workers;
+    SDL_sem* go;                    // posted once per worker and batch
+    SDL_sem* done;
+    SDL_atomic_t next;              // frame of the batch to take
+    Uint32 count;                   // frames in the batch
+    Uint8 quit;
+};
+
+// md5
+void md5Init(struct smd5* m);
+void md5Update(struct smd5* m, const Uint8* p, Uint32 n);
+void md5Final(struct smd5* m, Uint8* out); // 16 bytes
+
+// encoder
+int flacOpen(struct sflac* c, struct sarena* arena, const char* file, Uint32 rate);
+int flacWrite(struct sflac* c, const Sint16* in, Uint32 n);
+int flacClose(struct sflac* c);
+Uint32 flacEncodeFrame(Uint8* out, const Sint16* in, Uint32 n, Uint32 number, Uint32 rate); // returns bytes
+
+/*
+    functions bodies
+*/
+
+void md5Block(struct smd5* m, const Uint8* p)
+{
+    static const Uint32 k[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+    static const Uint8 r[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+    Uint32 w[16];
+    for(int i = 0; i < 16; i++)
+        w[i] = p[i*4] | (p[i*4+1] << 8) | (p[i*4+2] << 16) | ((Uint32)p[i*4+3] << 24);
+
+    Uint32 a = m->h[0], b = m->h[1], c = m->h[2], d = m->h[3];
+    for(int i = 0; i < 64; i++)
+    {
+        Uint32 f, g;
+        if(i < 16)
+            f = (b & c) | (~b & d), g = i;
+        else if(i < 32)
+            f = (d & b) | (~d & c), g = (5*i + 1) & 15;
+        else if(i < 48)
+            f = b ^ c ^ d, g = (3*i + 5) & 15;
+        else
+            f = c ^ (b | ~d), g = (7*i) & 15;
+        const Uint32 t = d;
+        d = c;
+        c = b;
+        const Uint32 x = a + f + k[i] + w[g];
+        b = b + ((x << r[i]) | (x >> (32 - r[i])));
+        a = t;
+    }
+    m->h[0] += a, m->h[1] += b, m->h[2] += c, m->h[3] += d;
+}
+
+void md5Init(struct smd5* m)
+{
+    m->h[0] = 0x67452301, m->h[1] = 0xefcdab89, m->h[2] = 0x98badcfe, m->h[3] = 0x10325476;
+    m->len = 0;
+}
+
+void md5Update(struct smd5* m, const Uint8* p, Uint32 n)
+{
+    Uint32 used = m->len & 63;
+    m->len += n;
+    while(n > 0)
+    {
+        Uint32 c = 64 - used;
+        if(c > n)
+            c = n;
+        memcpy(m->buf + used, p, c);
+        used += c;
+        p += c;
+        n -= c;
+        if(used == 64)
+        {
+            md5Block(m, m->buf);
+            used = 0;
+        }
+    }
+}
+
+void md5Final(struct smd5* m, Uint8* out)
+{
+    const Uint64 bits = m->len * 8;
+    Uint8 pad[72] = {0x80};
+    const Uint32 used = m->len & 63;
+    const Uint32 n = used < 56 ? 56 - used : 120 - used;
+    for(int i = 0; i < 8; i++)
+        pad[n+i] = bits >> (i*8);
+    md5Update(m, pad, n + 8);
+    for(int i = 0; i < 16; i++)
+        out[i] = m->h[i/4] >> ((i%4)*8);
+}
+
+/*
+    bit writer and checksums
+*/
+struct sbits
+{
+    Uint8* p;
+    Uint32 pos, cap;
+    Uint64 acc;
+    Uint32 n;       // bits waiting in acc
+    Uint8 full;     // cap was reached, the frame is dropped
+};
+
+void bitsPut(struct sbits* b, Uint32 v, Uint32 bits)
+{
+    // bits <= 32, anything above bits in v is ignored
+    if(bits == 0)
+        return;
+    b->acc = (b->acc << bits) | (v & (0xFFFFFFFFu >> (32 - bits)));
+    b->n += bits;
+    while(b->n >= 8)
+    {
+        b->n -= 8;
+        if(b->pos < b->cap)
+            b->p[b->pos++] = b->acc >> b->n;
+        else
+            b->full = 1;
+    }
+}
+
+void bitsRice(struct sbits* b, Uint32 u, Uint32 k)
+{
+    Uint32 q = u >> k;
+    for(; q >= 32; q -= 32)
+        bitsPut(b, 0, 32);
+    bitsPut(b, 1, q + 1);
+    bitsPut(b, u, k);
+}
+
+void bitsAlign(struct sbits* b)
+{
+    if(b->n > 0)
+        bitsPut(b, 0, 8 - b->n);
+}
+
+Uint8 crc8(const Uint8* p, Uint32 n)
+{
+    Uint8 c = 0;
+    for(Uint32 i = 0; i < n; i++)
+    {
+        c ^= p[i];
+        for(int j = 0; j < 8; j++)
+            c = c & 0x80 ? (c << 1) ^ 0x07 : c << 1;
+    }
+    return c;
+}
+
+Uint16 crc16(const Uint8* p, Uint32 n)
+{
+    Uint16 c = 0;
+    for(Uint32 i = 0; i < n; i++)
+    {
+        c ^= p[i] << 8;
+        for(int j = 0; j < 8; j++)
+            c = c & 0x8000 ? (c << 1) ^ 0x8005 : c << 1;
+    }
+    return c;
+}
+
+/*
+    prediction and residual coding
+*/
+Uint32 zigzag(Sint32 r)
+{
+    return ((Uint32)r << 1) ^ (Uint32)(r >> 31);
+}
+
+Uint64 riceBits(const Uint32* u, Uint32 n, Uint32 order, Uint32* part_order, Uint8* param)
+{
+    // estimated bits of the residual for the best partition order, the
+    // parameters of that order are left in param
+    Uint64 sum[1 << FLAC_MAX_PART];
+    Uint32 pmax = 0;
+    while(pmax < FLAC_MAX_PART && n % (2u << pmax) == 0 && (n >> (pmax+1)) > order)
+        pmax++;
+
+    // sums at the finest order, merged pairwise for the coarser ones
+    const Uint32 parts = 1 << pmax;
+    const Uint32 ps = n >> pmax;
+    for(Uint32 p = 0, i = order; p < parts; p++)
+    {
+        sum[p] = 0;
+        for(const Uint32 e = (p+1)*ps; i < e; i++)
+            sum[p] += u[i];
+    }
+
+    Uint64 best = (Uint64)-1;
+    for(Sint32 po = pmax; po >= 0; po--)
+    {
+        const Uint32 np = 1 << po;
+        Uint64 bits = 0;
+        Uint8 k[1 << FLAC_MAX_PART];
+        for(Uint32 p = 0; p < np; p++)
+        {
+            const Uint32 c = (n >> po) - (p == 0 ? order : 0);
+            Uint64 kb = (Uint64)-1;
+            for(Uint32 j = 0; j < 31; j++)
+            {
+                const Uint64 b = (Uint64)c * (j + 1) + (sum[p] >> j);
+                if(b < kb)
+                    kb = b, k[p] = j;
+                else
+                    break;
+            }
+            bits += kb + (k[p] > 14 ? 5 : 4);
+        }
+        if(bits < best)
+        {
+            best = bits;
+            *part_order = po;
+            memcpy(param, k, np);
+        }
+        if(po > 0)
+            for(Uint32 p = 0; p < np/2; p++)
+                sum[p] = sum[2*p] + sum[2*p+1];
+    }
+    return best + 6;
+}
+
+void riceWrite(struct sbits* b, const Uint32* u, Uint32 n, Uint32 order, Uint32 part_order, const Uint8* param)
+{
+    const Uint32 np = 1 << part_order;
+    Uint8 method = 0;
+    for(Uint32 p = 0; p < np; p++)
+        if(param[p] > 14)
+            method = 1;
+    bitsPut(b, method, 2);
+    bitsPut(b, part_order, 4);
+    for(Uint32 p = 0, i = order; p < np; p++)
+    {
+        bitsPut(b, param[p], method == 1 ? 5 : 4);
+        for(const Uint32 e = (p+1) * (n >> part_order); i < e; i++)
+            bitsRice(b, u[i], param[p]);
+    }
+}
+
+Uint8 fixedResidual(const Sint32* x, Uint32 n, Uint32 order, Uint32* u)
+{
+    for(Uint32 i = order; i < n; i++)
+    {
+        Sint32 r = x[i];
+        if(order == 1)
+            r = x[i] - x[i-1];
+        else if(order == 2)
+            r = x[i] - 2*x[i-1] + x[i-2];
+        else if(order == 3)
+            r = x[i] - 3*x[i-1] + 3*x[i-2] - x[i-3];
+        else if(order == 4)
+            r = x[i] - 4*x[i-1] + 6*x[i-2] - 4*x[i-3] + x[i-4];
+        u[i] = zigzag(r);
+    }
+    return 1;
+}
+
+Uint8 lpcResidual(const Sint32* x, Uint32 n, Uint32 order, const Sint32* q, Uint32 shift, Uint32* u)
+{
+    // 0 if a residual does not fit the 32 bits decoders expect
+    for(Uint32 i = order; i < n; i++)
+    {
+        Sint64 s = 0;
+        for(Uint32 j = 0; j < order; j++)
+            s += (Sint64)q[j] * x[i-j-1];
+        const Sint64 r = x[i] - (s >> shift);
+        if(r > 0x3FFFFFFF || r < -0x3FFFFFFF)
+            return 0;
+        u[i] = zigzag(r);
+    }
+    return 1;
+}
+
+Uint32 lpcCoefficients(const Sint32* x, Uint32 n, double lpc[FLAC_MAX_LPC][FLAC_MAX_LPC])
+{
+    // autocorrelation of the welch windowed block, then levinson-durbin,
+    // row o-1 holds the predictor of order o, returns the highest usable order
+    double r[FLAC_MAX_LPC+1] = {0.0};
+    float w[FLAC_BLOCK];
+    const double h = (n - 1) * 0.5;
+    for(Uint32 i = 0; i < n; i++)
+    {
+        const double d = (i - h) / (h + 1.0);
+        w[i] = x[i] * (1.0 - d*d);
+    }
+    for(Uint32 l = 0; l <= FLAC_MAX_LPC; l++)
+        for(Uint32 i = l; i < n; i++)
+            r[l] += (double)w[i] * w[i-l];
+    if(r[0] == 0.0)
+        return 0;
+
+    double a[FLAC_MAX_LPC] = {0.0};
+    double err = r[0] * (1.0 + 1e-9);
+    for(Uint32 o = 0; o < FLAC_MAX_LPC; o++)
+    {
+        double k = -r[o+1];
+        for(Uint32 j = 0; j < o; j++)
+            k -= a[j] * r[o-j];
+        k /= err;
+        double t[FLAC_MAX_LPC];
+        for(Uint32 j = 0; j < o; j++)
+            t[j] = a[j] + k * a[o-1-j];
+        memcpy(a, t, o * sizeof(double));
+        a[o] = k;
+        err *= 1.0 - k*k;
+        for(Uint32 j = 0; j <= o; j++)
+            lpc[o][j] = -a[j];
+        if(err <= 0.0)
+            return o + 1;
+    }
+    return FLAC_MAX_LPC;
+}
+
+Uint8 lpcQuantise(const double* lpc, Uint32 order, Sint32* q, Uint32* shift)
+{
+    double cmax = 0.0;
+    for(Uint32 j = 0; j < order; j++)
+        if(fabs(lpc[j]) > cmax)
+            cmax = fabs(lpc[j]);
+    if(cmax <= 0.0)
+        return 0;
+    int log2cmax;
+    frexp(cmax, &log2cmax);
+    int s = FLAC_PRECISION - 2 - (log2cmax - 1);
+    if(s > 15)
+        s = 15;
+    else if(s < 0)
+        return 0;
+
+    const Sint32 qmax = (1 << (FLAC_PRECISION-1)) - 1;
+    double e = 0.0;
+    for(Uint32 j = 0; j < order; j++)
+    {
+        e += lpc[j] * (1 << s);
+        Sint32 v = lround(e);
+        if(v > qmax)
+            v = qmax;
+        else if(v < -qmax-1)
+            v = -qmax-1;
+        e -= v;
+        q[j] = v;
+    }
+    *shift = s;
+    return 1;
+}
+
+void subframeWrite(struct sbits* b, const Sint32* x, Uint32 n, Sint32 type, Uint32 order, const Sint32* q, Uint32 shift, const Uint32* u, Uint32 part_order, const Uint8* param)
+{
+    // type -1 verbatim, 0 constant, 1 fixed, 2 lpc
+    if(type == 0)
+    {
+        bitsPut(b, 0x00, 8);
+        bitsPut(b, x[0], 16);
+        return;
+    }
+    if(type < 0)
+    {
+        bitsPut(b, 0x02, 8);
+        for(Uint32 i = 0; i < n; i++)
+            bitsPut(b, x[i], 16);
+        return;
+    }
+
+    bitsPut(b, type == 1 ? (0x08 | order) << 1 : (0x20 | (order-1)) << 1, 8);
+    for(Uint32 i = 0; i < order; i++)
+        bitsPut(b, x[i], 16);
+    if(type == 2)
+    {
+        bitsPut(b, FLAC_PRECISION-1, 4);
+        bitsPut(b, shift, 5);
+        for(Uint32 j = 0; j < order; j++)
+            bitsPut(b, q[j], FLAC_PRECISION);
+    }
+    riceWrite(b, u, n, order, part_order, param);
+}
+
+Uint32 flacEncodeFrame(Uint8* out, const Sint16* in, Uint32 n, Uint32 number, Uint32 rate)
+{
+    struct sbits b = {out, 0, FLAC_FRAME_MAX, 0, 0, 0};
+
+    // header, fixed blocking, mono, 16-bit
+    bitsPut(&b, 0xFFF8, 16);
+    const Uint32 bs = n == FLAC_BLOCK ? 12 : 7; // 4096, or 16-bit size at the end
+    Uint32 sr = 0;
+    if(rate == 44100)
+        sr = 9;
+    else if(rate == 48000)
+        sr = 10;
+    else if(rate == 96000)
+        sr = 11;
+    bitsPut(&b, (bs << 4) | sr, 8);
+    bitsPut(&b, 0x08, 8); // mono, 16 bits per sample
+    if(number < 0x80)
+        bitsPut(&b, number, 8);
+    else
+    {
+        // utf-8 style frame number
+        Uint32 c = 1;
+        while(c < 6 && number >= (1u << (5*c + 6)))
+            c++;
+        bitsPut(&b, (0xFF << (7 - c)) | (number >> (6*c)), 8);
+        for(Sint32 i = c-1; i >= 0; i--)
+            bitsPut(&b, 0x80 | ((number >> (6*i)) & 0x3F), 8);
+    }
+    if(bs == 7)
+        bitsPut(&b, n - 1, 16);
+    bitsPut(&b, crc8(out, b.pos), 8);
+    const Uint32 head = b.pos;
+
+    Sint32 x[FLAC_BLOCK];
+    x[0] = in[0]; // a frame holds at least one sample
+    Uint8 same = 1;
+    for(Uint32 i = 1; i < n; i++)
+    {
+        x[i] = in[i];
+        if(x[i] != x[0])
+            same = 0;
+    }
+
+    if(same == 1)
+    {
+        subframeWrite(&b, x, n, 0, 0, NULL, 0, NULL, 0, NULL);
+    }
+    else
+    {
+        // best fixed order, then see if lpc beats it
+        Uint32 u[FLAC_BLOCK], ubest[FLAC_BLOCK];
+        Uint8 param[1 << FLAC_MAX_PART], pbest[1 << FLAC_MAX_PART];
+        Uint32 po, pobest = 0;
+        Sint32 type = -1;
+        Uint32 order = 0, shift = 0;
+        Sint32 q[FLAC_MAX_LPC], qbest[FLAC_MAX_LPC];
+        Uint64 best = (Uint64)n * 16;
+
+        for(Uint32 o = 0; o <= 4 && o < n; o++)
+        {
+            fixedResidual(x, n, o, u);
+            const Uint64 bits = 8 + o*16 + riceBits(u, n, o, &po, param);
+            if(bits < best)
+            {
+                best = bits, type = 1, order = o, pobest = po;
+                memcpy(ubest, u, n * sizeof(Uint32));
+                memcpy(pbest, param, sizeof(param));
+            }
+        }
+
+        double lpc[FLAC_MAX_LPC][FLAC_MAX_LPC];
+        const Uint32 omax = n > FLAC_MAX_LPC*2 ? lpcCoefficients(x, n, lpc) : 0;
+        const Uint32 orders[3] = {4, 8, FLAC_MAX_LPC};
+        for(int k = 0; k < 3; k++)
+        {
+            const Uint32 o = orders[k];
+            Uint32 s;
+            if(o > omax || lpcQuantise(lpc[o-1], o, q, &s) == 0 || lpcResidual(x, n, o, q, s, u) == 0)
+                continue;
+            const Uint64 bits = 8 + o*16 + 9 + o*FLAC_PRECISION + riceBits(u, n, o, &po, param);
+            if(bits < best)
+            {
+                best = bits, type = 2, order = o, shift = s, pobest = po;
+                memcpy(qbest, q, o * sizeof(Sint32));
+                memcpy(ubest, u, n * sizeof(Uint32));
+                memcpy(pbest, param, sizeof(param));
+            }
+        }
+
+        subframeWrite(&b, x, n, type, order, qbest, shift, ubest, pobest, pbest);
+
+        // the estimate was off, verbatim is never larger than this
+        if(b.full == 1 || (b.pos - head) * 8 > (Uint64)n * 16 + 8)
+        {
+            b.pos = head, b.n = 0, b.full = 0;
+            subframeWrite(&b, x, n, -1, 0, NULL, 0, NULL, 0, NULL);
+        }
+    }
+
+    bitsAlign(&b);
+    const Uint16 c = crc16(out, b.pos);
+    bitsPut(&b, c, 16);
+    return b.pos;
+}
+
+/*
+    stream
+*/
+void flacFrames(struct sflac* c)
+{
+    // the frames of the batch nobody took yet
+    Uint32 k;
+    while((k = SDL_AtomicAdd(&c->next, 1)) < c->count)
+    {
+        const Uint32 pos = k * FLAC_BLOCK;
+        const Uint32 n = c->fill - pos < FLAC_BLOCK ? c->fill - pos : FLAC_BLOCK;
+        c->frame_len[k] = flacEncodeFrame(c->frame[k], &c->pcm[pos], n, c->frames + k, c->rate);
+    }
+}
+
+int flacWorker(void* data)
+{
+    struct sflac* c = data;
+    while(1)
+    {
+        SDL_SemWait(c->go);
+        if(c->quit == 1)
+            return 0;
+        flacFrames(c);
+        SDL_SemPost(c->done);
+    }
+}
+
+void flacStart(struct sflac* c)
+{
+    // without semaphores or threads the writing thread encodes alone
+    Uint32 threads = SDL_GetCPUCount();
+    if(threads > FLAC_BATCH)
+        threads = FLAC_BATCH;
+    c->go = SDL_CreateSemaphore(0);
+    c->done = SDL_CreateSemaphore(0);
+    for(Uint32 i = 1; i < threads && c->go != NULL && c->done != NULL; i++)
+    {
+        c->worker[c->workers] = SDL_CreateThread(flacWorker, "borg_flac", c);
+        if(c->worker[c->workers] != NULL)
+            c->workers++;
+    }
+}
+
+void flacStop(struct sflac* c)
+{
+    c->quit = 1;
+    for(Uint32 i = 0; i < c->workers; i++)
+        SDL_SemPost(c->go);
+    for(Uint32 i = 0; i < c->workers; i++)
+        SDL_WaitThread(c->worker[i], NULL);
+    if(c->go != NULL)
+        SDL_DestroySemaphore(c->go);
+    if(c->done != NULL)
+        SDL_DestroySemaphore(c->done);
+    c->workers = 0;
+}
+
+void flacBatch(struct sflac* c)
+{
+    // encode the waiting frames across the workers, then write them in order
+    const Uint32 count = (c->fill + FLAC_BLOCK - 1) / FLAC_BLOCK;
+    c->count = count;
+    SDL_AtomicSet(&c->next, 0);
+    for(Uint32 i = 0; i < c->workers; i++)
+        SDL_SemPost(c->go);
+    flacFrames(c);
+    for(Uint32 i = 0; i < c->workers; i++)
+        SDL_SemWait(c->done);
+
+    for(Uint32 k = 0; k < count; k++)
+    {
+        const Uint32 l = c->frame_len[k];
+        if(c->err == 0 && fwrite(c->frame[k], l, 1, c->f) != 1)
+            c->err = -1;
+        if(l < c->min_frame || c->min_frame == 0)
+            c->min_frame = l;
+        if(l > c->max_frame)
+            c->max_frame = l;
+        c->bytes += l;
+    }
+    c->frames += count;
+    c->fill = 0;
+}
+
+void flacStreamInfo(Uint8* h, const struct sflac* c, const Uint8* md5)
+{
+    // fLaC, then STREAMINFO as the last metadata block
+    const Uint32 block = FLAC_BLOCK;
+    memcpy(h, "fLaC", 4);
+    h[4] = 0x80, h[5] = 0, h[6] = 0, h[7] = 34;
+    h[8] = block >> 8, h[9] = block & 0xFF;
+    h[10] = block >> 8, h[11] = block & 0xFF;
+    h[12] = c->min_frame >> 16, h[13] = c->min_frame >> 8, h[14] = c->min_frame;
+    h[15] = c->max_frame >> 16, h[16] = c->max_frame >> 8, h[17] = c->max_frame;
+    h[18] = c->rate >> 12;
+    h[19] = c->rate >> 4;
+    h[20] = ((c->rate & 15) << 4) | (0 << 1) | (15 >> 4); // 1 channel, 16 bits
+    h[21] = ((15 & 15) << 4) | ((c->len >> 32) & 15);
+    h[22] = c->len >> 24, h[23] = c->len >> 16, h[24] = c->len >> 8, h[25] = c->len;
+    memcpy(h+26, md5, 16);
+}
+
+int flacOpen(struct sflac* c, struct sarena* arena, const char* file, Uint32 rate)
+{
+    memset(c, 0x00, sizeof(struct sflac));
+    c->rate = rate;
+    c->arena = arena;
+    c->mark = arenaMark(arena);
+    c->pcm = arenaAlloc(arena, FLAC_BATCH*FLAC_BLOCK*sizeof(Sint16));
+    for(int k = 0; k < FLAC_BATCH; k++)
+        c->frame[k] = arenaAlloc(arena, FLAC_FRAME_MAX);
+    if(c->pcm == NULL || c->frame[FLAC_BATCH-1] == NULL)
+    {
+        arenaRelease(arena, c->mark);
+        return -1;
+    }
+    c->f = fopen(file, "wb");
+    if(c->f == NULL)
+    {
+        arenaRelease(arena, c->mark);
+        return -1;
+    }
+
+    // placeholder header, rewritten by flacClose
+    Uint8 h[42], md5[16] = {0};
+    flacStreamInfo(h, c, md5);
+    if(fwrite(h, 42, 1, c->f) != 1)
+        c->err = -1;
+    c->bytes = 42;
+    md5Init(&c->md5);
+    flacStart(c);
+    return 1;
+}
+
+int flacWrite(struct sflac* c, const Sint16* in, Uint32 n)
+{
+    if(c->len + n >= (1ull << 36))
+        c->err = -1;
+    while(n > 0 && c->err == 0)
+    {
+        Uint32 k = FLAC_BATCH*FLAC_BLOCK - c->fill;
+        if(k > n)
+            k = n;
+        memcpy(&c->pcm[c->fill], in, k * sizeof(Sint16));
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+        md5Update(&c->md5, (const Uint8*)in, k * sizeof(Sint16));
+#else
+        for(Uint32 i = 0; i < k; i++)
+        {
+            const Uint8 le[2] = {(Uint16)in[i], (Uint16)in[i] >> 8};
+            md5Update(&c->md5, le, 2);
+        }
+#endif
+        c->fill += k;
+        c->len += k;
+        in += k;
+        n -= k;
+        if(c->fill == FLAC_BATCH*FLAC_BLOCK)
+            flacBatch(c);
+    }
+    return c->err == 0 ? 1 : -1;
+}
+
+int flacClose(struct sflac* c)
+{
+    if(c->err == 0 && c->fill > 0)
+        flacBatch(c);
+    if(c->err == 0)
+    {
+        Uint8 h[42], md5[16];
+        md5Final(&c->md5, md5);
+        flacStreamInfo(h, c, md5);
+        if(fseek(c->f, 0, SEEK_SET) != 0 || fwrite(h, 42, 1, c->f) != 1)
+            c->err = -1;
+    }
+    flacStop(c);
+    if(fclose(c->f) != 0)
+        c->err = -1;
+    arenaRelease(c->arena, c->mark);
+    return c->err == 0 ? 1 : -1;
+}
+
+#endif
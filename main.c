@@ -18,21 +18,28 @@
 */
 #include <SDL2/SDL.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <math.h>
 
 #ifdef __linux__
     #include <sys/stat.h>
+    #include <sys/inotify.h>
+    #include <poll.h>
+    #include <errno.h>
 #endif
 
 #include "sdl_extra.h"
 #include "synth.h"
 #include "res.h"
+#include "fft.h"
+#include "conv.h"
+#include "fixed.h"
+#include "biquad.h"
+#include "store.h"
 
 #define SAMPLE_RATE   44100
 float reciprocal_sample_rate = 0.f;
 
-//#define HERMITE_INTERPOLATE // makes no real audible difference
-
 #define MAXFREQUENCY  1800 //20000
 #define MAXAMPLITUDE  128 //SDL_MIX_MAXVOLUME
 #define MAXRESOLUTION 30
@@ -42,6 +49,16 @@ float reciprocal_sample_rate = 0.f;
 #define MAXOFFSETA    MAXAMPLITUDE
 #define MAXCRUSH      1
 #define MAXSAMPLELEN  33
+#define MAXUNISON     8
+#define MAXDETUNE     100 // cents
+#define MAXMODRATE    20  // Hz
+#define MODSLOTS      4
+#define MODBLOCK      64  // samples per control-rate block
+#define MAXHIRES      512 // resolution of hi-res (IFFT) oscillators
+#define HIRES_TABLE   4096
+#define HIRES_HOP     256
+#define CONV_BLOCK    512 // reverb partition size
+#define MAXIMPULSE    99  // ir-1.wav to ir-99.wav
 
 #define wlerp(a, b, i) ((b - a) * i + a)
 
@@ -67,9 +84,12 @@ Uint32 scopecolor = 0xFF363636;
 Uint32 select_lightness = 44;
 
 Uint8 select_mode;
-Uint8 selected_bank = 0;
+_Thread_local Uint32 selected_bank = 0; // per thread so banks can render in parallel
 Sint32 selected_dial = -1;
 Uint8 envelope_enabled = 0;
+Uint32 export_format = SAMPLE_U8;
+Uint32 export_rate = 0; // 0 exports at the render rate
+Uint32 export_quality = RESAMPLE_GOOD;
 
 float scope_zoom = 466.f;
 
@@ -84,6 +104,7 @@ SDL_Rect secr_rect      = {366, 416, 12, 14};
 SDL_Rect export_rect    = {380, 416, 46, 14};
 SDL_Rect play_rect      = {428, 416, 46, 14};
 SDL_Rect envelope_rect  = {7, 155, 466, 126};
+SDL_Rect scope_rect     = {7, 286, 466, 126};
 
 SDL_Rect dial_rect[50];
 SDL_Rect mul_rect[10];
@@ -104,644 +125,3996 @@ struct ssynth
     Uint8 fm_state[10];
     
     float dial_state[50]; // 0-1
+
+    // appended fields, older saves are loaded without them
+    Uint8 unison_state[8]; // extra unison voices per oscillator (0-7)
+    float detune_state[8]; // 0-1
+    float spread_state[8]; // 0-1
+
+    Uint8 mod_type[MODSLOTS];   // 0 = off, see mod_names
+    Uint8 mod_target[MODSLOTS]; // dial index
+    float mod_rate[MODSLOTS];   // 0-1
+    float mod_depth[MODSLOTS];  // -1 to 1
+
+    Uint8 hires_state[8];       // oscillator uses the IFFT engine above MAXRESOLUTION
+
+    Uint8 ir_state;             // reverb impulse response ir-N.wav, 0 = off
+    float ir_mix;               // 0-1
+
+    Uint8 env_interp;           // envelope interpolation, 0 = linear, 1 = hermite
 };
-struct ssynth synth[256];
+struct ssynth* synth = NULL; // banks decoded from the library as they are selected
 
-void saveState()
+/*
+    banks.lib
+
+    The banks are the records of a store.h library in the app
+    directory, or the file given with --library. Every edit marks
+    its bank dirty, a save writes only the dirty records and Load
+    reads them back from the file. Whether a bank has dials set is
+    kept in the index so it can be answered without its record.
+
+    A record is the bank packed to half the size of the struct,
+    the envelope and dials in 16-bit fixed point and the routing
+    states in 2 bits each, with a checksum of its own. A bank is
+    decoded into synth[] the first time it is selected and encoded
+    when it is saved, after which it holds what the file holds.
+
+      0  seclen, envelope interpolation, impulse response
+      3  am, mul and fm states, 2 bits each
+     11  hires flags, 1 bit each
+     12  unison voices, 3 bits each
+     15  modulation types, then targets
+     23  envelope, 466 x 16-bit 0-1
+    955  dials, 50 x 16-bit -1 to 1
+   1055  detune, then spread, 8 x 16-bit 0-1
+   1087  modulation rates 0-1, then depths -1 to 1, 4 x 16-bit
+   1103  reverb mix, 16-bit 0-1
+   1105  FNV-1a of the above, low 32 bits
+
+    Values are little endian. Libraries of raw struct records, and
+    a bank.save from before the library, are converted once.
+*/
+#define BANK_FORMAT 1    // records as above, 0 is the raw struct
+#define BANK_SUM    1105
+#define BANK_RECORD 1109
+
+struct sstore store;
+char* library_path = NULL;
+Uint8* bank_ready = NULL; // synth[] holds the decoded bank
+Uint32 bank_room = 0;     // banks synth[] has room for
+Uint8 edit_pending = 0;   // a bank changed since the history last looked
+SDL_mutex* library_lock = NULL; // held while store and synth[] change, NULL without a background reader
+SDL_mutex* index_lock = NULL;   // held by the indexer while it renders, synth[] is not moved meanwhile
+
+void libraryLock()
 {
-    char file[256];
-    sprintf(file, "%sbank.save", appdir);
-    FILE* f = fopen(file, "wb");
-    if(f != NULL)
-    {
-        if(fwrite(&synth[0], sizeof(struct ssynth), 256, f) != 256)
-            printf("fwrite() wrote the wrong amount of bytes, save corrupted.\n");
-        fclose(f);
-    }
+    if(library_lock != NULL)
+        SDL_LockMutex(library_lock);
 }
 
-void loadState()
+void libraryUnlock()
 {
-    char file[256];
-    sprintf(file, "%sbank.save", appdir);
-    FILE* f = fopen(file, "rb");
-    if(f != NULL)
-    {
-        unsigned int strikeout = 0;
-        while(fread(&synth[0], sizeof(struct ssynth), 256, f) != 256)
-        {
-            printf("Read bank failed... Trying again.\n");
-            strikeout++;
-            if(strikeout > 3333)
-            {
-                printf("Loading your data totally failed. ¯\\_(ツ)_/¯ Maybe it's corrupted? :(\n");
-                break;
-            }
-        }
-        fclose(f);
-    }
+    if(library_lock != NULL)
+        SDL_UnlockMutex(library_lock);
 }
 
-float oscphase[8] = {0.f}; // oscillator phases
-float doOsc(Uint32 oscid, float input1, float input2)
+void markDirty(Uint32 bank)
 {
-    float o = 0.f;
-    float f = 0.f, a = 0.f, r = 0.f, t = 0.f;
-    Uint8 input1_fmmod = 0, input1_ammod = 0, input1_mod = 0;
-    Uint8 input2_fmmod = 0, input2_ammod = 0, input2_mod = 0;
+    store.dirty[bank] = 1;
+    bank_ready[bank] = 1;
+    edit_pending = 1;
+}
 
-    // load selected oscillator dial values with scaling
-    if(oscid == 1)
-    {
-        f = synth[selected_bank].dial_state[16] * dial_scale[16];
-        a = synth[selected_bank].dial_state[17] * dial_scale[17];
-        r = synth[selected_bank].dial_state[18] * dial_scale[18];
-        t = synth[selected_bank].dial_state[19] * dial_scale[19];
+Uint8 recordUsed(const struct ssynth* s)
+{
+    if(s->seclen == 0)
+        return 0;
+    for(int i = 0; i < 50; i++)
+        if(s->dial_state[i] != 0.f)
+            return 1;
+    return 0;
+}
 
-        input1_ammod = synth[selected_bank].am_state[9];
-        input1_mod = synth[selected_bank].mul_state[9];
-        input1_fmmod = synth[selected_bank].fm_state[9];
+Uint8 bankUsed(Uint32 b)
+{
+    // clean banks answer from the index without paging their record in
+    if(store.dirty[b] == 0)
+        return storeIntact(&store) == 1 && (store.index[b] & STORE_USED) != 0;
+    return recordUsed(&synth[b]);
+}
 
-        input2_ammod = synth[selected_bank].am_state[8];
-        input2_mod = synth[selected_bank].mul_state[8];
-        input2_fmmod = synth[selected_bank].fm_state[8];
-    }
-    else if(oscid == 2)
-    {
-        // are any outputs enabled?
-        if(synth[selected_bank].am_state[8] + synth[selected_bank].mul_state[8] + synth[selected_bank].fm_state[8] == 0){return 0.f;}
+void blankBank(struct ssynth* s)
+{
+    memset(s, 0x00, sizeof(struct ssynth));
+    for(int j = 0; j < 466; j++)
+        s->envelope[j] = 0.5f;
+    s->seclen = 3;
+}
 
-        f = synth[selected_bank].dial_state[20] * dial_scale[20];
-        a = synth[selected_bank].dial_state[21] * dial_scale[21];
-        r = synth[selected_bank].dial_state[22] * dial_scale[22];
-        t = synth[selected_bank].dial_state[23] * dial_scale[23];
+void putU16(Uint8* p, Uint32 v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
 
-        input1_ammod = synth[selected_bank].am_state[6];
-        input1_mod = synth[selected_bank].mul_state[6];
-        input1_fmmod = synth[selected_bank].fm_state[6];
+Uint32 getU16(const Uint8* p)
+{
+    return p[0] | (p[1] << 8);
+}
 
-        input2_ammod = synth[selected_bank].am_state[5];
-        input2_mod = synth[selected_bank].mul_state[5];
-        input2_fmmod = synth[selected_bank].fm_state[5];
-    }
-    else if(oscid == 3)
-    {
-        // are any outputs enabled?
-        if(synth[selected_bank].am_state[5] + synth[selected_bank].mul_state[5] + synth[selected_bank].fm_state[5] == 0){return 0.f;}
+// even scales so 0.5 and 1 are exact
+Uint32 unorm16(float v)
+{
+    return (Uint32)(fminf(fmaxf(v, 0.f), 1.f) * 65534.f + 0.5f);
+}
 
-        f = synth[selected_bank].dial_state[24] * dial_scale[24];
-        a = synth[selected_bank].dial_state[25] * dial_scale[25];
-        r = synth[selected_bank].dial_state[26] * dial_scale[26];
-        t = synth[selected_bank].dial_state[27] * dial_scale[27];
+Uint32 snorm16(float v)
+{
+    return (Uint16)(Sint16)lrintf(fminf(fmaxf(v, -1.f), 1.f) * 32766.f);
+}
 
-        input1_ammod = synth[selected_bank].am_state[3];
-        input1_mod = synth[selected_bank].mul_state[3];
-        input1_fmmod = synth[selected_bank].fm_state[3];
+void putBits(Uint8* p, Uint32 bit, Uint32 n, Uint32 v)
+{
+    // into zeroed bytes, lowest bit first
+    for(Uint32 i = 0; i < n; i++, bit++)
+        if(((v >> i) & 1) == 1)
+            p[bit/8] |= 1 << (bit%8);
+}
 
-        input2_ammod = synth[selected_bank].am_state[2];
-        input2_mod = synth[selected_bank].mul_state[2];
-        input2_fmmod = synth[selected_bank].fm_state[2];
+Uint32 getBits(const Uint8* p, Uint32 bit, Uint32 n)
+{
+    Uint32 v = 0;
+    for(Uint32 i = 0; i < n; i++, bit++)
+        v |= ((p[bit/8] >> (bit%8)) & 1) << i;
+    return v;
+}
+
+void bankEncode(const struct ssynth* s, Uint8* r)
+{
+    memset(r, 0x00, BANK_RECORD);
+    r[0] = s->seclen;
+    r[1] = s->env_interp;
+    r[2] = s->ir_state;
+    for(int i = 0; i < 10; i++)
+    {
+        putBits(&r[3], i*2, 2, s->am_state[i]);
+        putBits(&r[3], 20 + i*2, 2, s->mul_state[i]);
+        putBits(&r[3], 40 + i*2, 2, s->fm_state[i]);
     }
-    else if(oscid == 4)
+    for(int i = 0; i < 8; i++)
     {
-        // are any outputs enabled?
-        if(synth[selected_bank].am_state[2] + synth[selected_bank].mul_state[2] + synth[selected_bank].fm_state[2] == 0){return 0.f;}
-
-        f = synth[selected_bank].dial_state[28] * dial_scale[28];
-        a = synth[selected_bank].dial_state[29] * dial_scale[29];
-        r = synth[selected_bank].dial_state[30] * dial_scale[30];
-        t = synth[selected_bank].dial_state[31] * dial_scale[31];
-
-        input1_ammod = synth[selected_bank].am_state[0];
-        input1_mod = synth[selected_bank].mul_state[0];
-        input1_fmmod = synth[selected_bank].fm_state[0];
-
-        input2_ammod = 0;
-        input2_mod = 0;
-        input2_fmmod = 0;
+        putBits(&r[11], i, 1, s->hires_state[i]);
+        putBits(&r[12], i*3, 3, s->unison_state[i]);
     }
-    else if(oscid == 5)
+    for(int i = 0; i < MODSLOTS; i++)
     {
-        // are any outputs enabled?
-        if(synth[selected_bank].am_state[9] + synth[selected_bank].mul_state[9] + synth[selected_bank].fm_state[9] == 0){return 0.f;}
-
-        f = synth[selected_bank].dial_state[0] * dial_scale[0];
-        a = synth[selected_bank].dial_state[1] * dial_scale[1];
-        r = synth[selected_bank].dial_state[2] * dial_scale[2];
-        t = synth[selected_bank].dial_state[3] * dial_scale[3];
-        
-        input1_ammod = synth[selected_bank].am_state[7];
-        input1_mod = synth[selected_bank].mul_state[7];
-        input1_fmmod = synth[selected_bank].fm_state[7];
+        r[15+i] = s->mod_type[i];
+        r[19+i] = s->mod_target[i];
+    }
+    Uint8* p = &r[23];
+    for(int i = 0; i < 466; i++, p += 2)
+        putU16(p, unorm16(s->envelope[i]));
+    for(int i = 0; i < 50; i++, p += 2)
+        putU16(p, snorm16(s->dial_state[i]));
+    for(int i = 0; i < 8; i++, p += 2)
+        putU16(p, unorm16(s->detune_state[i]));
+    for(int i = 0; i < 8; i++, p += 2)
+        putU16(p, unorm16(s->spread_state[i]));
+    for(int i = 0; i < MODSLOTS; i++, p += 2)
+        putU16(p, unorm16(s->mod_rate[i]));
+    for(int i = 0; i < MODSLOTS; i++, p += 2)
+        putU16(p, snorm16(s->mod_depth[i]));
+    putU16(p, unorm16(s->ir_mix));
+
+    const Uint32 sum = storeSum(r, BANK_SUM);
+    putU16(&r[BANK_SUM], sum);
+    putU16(&r[BANK_SUM+2], sum >> 16);
+}
 
-        input2_ammod = 0;
-        input2_mod = 0;
-        input2_fmmod = 0;
+int bankDecode(const Uint8* r, struct ssynth* s)
+{
+    // -1 when the checksum does not match, s is untouched
+    const Uint32 sum = storeSum(r, BANK_SUM);
+    if(getU16(&r[BANK_SUM]) != (sum & 0xFFFF) || getU16(&r[BANK_SUM+2]) != sum >> 16)
+        return -1;
+    memset(s, 0x00, sizeof(struct ssynth));
+    s->seclen = r[0];
+    s->env_interp = r[1];
+    s->ir_state = r[2];
+    for(int i = 0; i < 10; i++)
+    {
+        s->am_state[i] = getBits(&r[3], i*2, 2);
+        s->mul_state[i] = getBits(&r[3], 20 + i*2, 2);
+        s->fm_state[i] = getBits(&r[3], 40 + i*2, 2);
     }
-    else if(oscid == 6)
+    for(int i = 0; i < 8; i++)
     {
-        // are any outputs enabled?
-        if( synth[selected_bank].am_state[6] + synth[selected_bank].mul_state[6] + synth[selected_bank].fm_state[6] +
-            synth[selected_bank].am_state[7] + synth[selected_bank].mul_state[7] + synth[selected_bank].fm_state[7] == 0){return 0.f;}
-
-        f = synth[selected_bank].dial_state[4] * dial_scale[4];
-        a = synth[selected_bank].dial_state[5] * dial_scale[5];
-        r = synth[selected_bank].dial_state[6] * dial_scale[6];
-        t = synth[selected_bank].dial_state[7] * dial_scale[7];
-
-        input1_ammod = synth[selected_bank].am_state[4];
-        input1_mod = synth[selected_bank].mul_state[4];
-        input1_fmmod = synth[selected_bank].fm_state[4];
-
-        input2_ammod = 0;
-        input2_mod = 0;
-        input2_fmmod = 0;
+        s->hires_state[i] = getBits(&r[11], i, 1);
+        s->unison_state[i] = getBits(&r[12], i*3, 3);
     }
-    else if(oscid == 7)
+    for(int i = 0; i < MODSLOTS; i++)
     {
-        // are any outputs enabled?
-        if( synth[selected_bank].am_state[3] + synth[selected_bank].mul_state[3] + synth[selected_bank].fm_state[3] +
-            synth[selected_bank].am_state[4] + synth[selected_bank].mul_state[4] + synth[selected_bank].fm_state[4] == 0){return 0.f;}
-
-        f = synth[selected_bank].dial_state[8] * dial_scale[8];
-        a = synth[selected_bank].dial_state[9] * dial_scale[9];
-        r = synth[selected_bank].dial_state[10] * dial_scale[10];
-        t = synth[selected_bank].dial_state[11] * dial_scale[11];
+        s->mod_type[i] = r[15+i];
+        s->mod_target[i] = r[19+i];
+    }
+    const Uint8* p = &r[23];
+    for(int i = 0; i < 466; i++, p += 2)
+        s->envelope[i] = (float)getU16(p) / 65534.f;
+    for(int i = 0; i < 50; i++, p += 2)
+        s->dial_state[i] = (float)(Sint16)getU16(p) / 32766.f;
+    for(int i = 0; i < 8; i++, p += 2)
+        s->detune_state[i] = (float)getU16(p) / 65534.f;
+    for(int i = 0; i < 8; i++, p += 2)
+        s->spread_state[i] = (float)getU16(p) / 65534.f;
+    for(int i = 0; i < MODSLOTS; i++, p += 2)
+        s->mod_rate[i] = (float)getU16(p) / 65534.f;
+    for(int i = 0; i < MODSLOTS; i++, p += 2)
+        s->mod_depth[i] = (float)(Sint16)getU16(p) / 32766.f;
+    s->ir_mix = (float)getU16(p) / 65534.f;
+    return 1;
+}
 
-        input1_ammod = synth[selected_bank].am_state[1];
-        input1_mod = synth[selected_bank].mul_state[1];
-        input1_fmmod = synth[selected_bank].fm_state[1];
+Uint8* encodeBanks(const struct ssynth* banks, Uint32 n, Uint32* flags)
+{
+    // records and index flags for a new library or for the end of this one
+    Uint8* r = malloc((size_t)n * BANK_RECORD + 1);
+    if(r == NULL)
+        return NULL;
+    for(Uint32 i = 0; i < n; i++)
+    {
+        bankEncode(&banks[i], r + (size_t)i * BANK_RECORD);
+        flags[i] = recordUsed(&banks[i]) == 1 ? STORE_USED : 0;
+    }
+    return r;
+}
 
-        input2_ammod = 0;
-        input2_mod = 0;
-        input2_fmmod = 0;
+int bankRoom(Uint32 count)
+{
+    // synth[] grows with the library, on Linux banks never selected cost no memory
+    if(count <= bank_room)
+        return 1;
+    const Uint32 n = storeCapacity(count);
+    const size_t size = (size_t)n * sizeof(struct ssynth);
+#ifdef __linux__
+    struct ssynth* s = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if(s == MAP_FAILED)
+        return -1;
+#else
+    struct ssynth* s = malloc(size);
+    if(s == NULL)
+        return -1;
+#endif
+    Uint8* ready = calloc(n, 1);
+    if(ready == NULL)
+    {
+#ifdef __linux__
+        munmap(s, size);
+#else
+        free(s);
+#endif
+        return -1;
     }
-    else if(oscid == 8)
+    libraryLock();
+    if(index_lock != NULL)
+        SDL_LockMutex(index_lock);
+    for(Uint32 b = 0; b < bank_room; b++)
     {
-        // are any outputs enabled?
-        if( synth[selected_bank].am_state[0] + synth[selected_bank].mul_state[0] + synth[selected_bank].fm_state[0] +
-            synth[selected_bank].am_state[1] + synth[selected_bank].mul_state[1] + synth[selected_bank].fm_state[1] == 0){return 0.f;}
-
-        f = synth[selected_bank].dial_state[12] * dial_scale[12];
-        a = synth[selected_bank].dial_state[13] * dial_scale[13];
-        r = synth[selected_bank].dial_state[14] * dial_scale[14];
-        t = synth[selected_bank].dial_state[15] * dial_scale[15];
-
-        input1_ammod = 0;
-        input1_mod = 0;
-        input1_fmmod = 0;
-
-        input2_ammod = 0;
-        input2_mod = 0;
-        input2_fmmod = 0;
+        if(bank_ready[b] == 1)
+        {
+            s[b] = synth[b];
+            ready[b] = 1;
+        }
     }
+#ifdef __linux__
+    if(synth != NULL)
+        munmap(synth, (size_t)bank_room * sizeof(struct ssynth));
+#else
+    free(synth);
+#endif
+    free(bank_ready);
+    synth = s;
+    bank_ready = ready;
+    bank_room = n;
+    if(index_lock != NULL)
+        SDL_UnlockMutex(index_lock);
+    libraryUnlock();
+    return 1;
+}
 
-    // fm modulation inputs
-    if(input1_fmmod != 0)
+void bankLoad(Uint32 b)
+{
+    // decoded the first time the bank is selected
+    if(bank_ready[b] == 1)
+        return;
+    if(storeIntact(&store) == 0)
     {
-        if(input1_fmmod == 1)
-            f *= input1;
-        else if(input1_fmmod == 2)
-            t *= squish(input1);
-        else if(input1_fmmod == 3)
-            r *= squish(input1);
+        blankBank(&synth[b]); // decoded again once the file is reloaded
+        return;
     }
+    if(bankDecode(store.base + (size_t)b * BANK_RECORD, &synth[b]) < 0)
+    {
+        printf("Bank %u failed its checksum and was loaded blank.\n", b);
+        blankBank(&synth[b]);
+    }
+    bank_ready[b] = 1;
+}
 
-    if(input2_fmmod != 0)
+int loadLegacy(const char* file, struct ssynth* banks)
+{
+    // 256 records back to back, saves from before the appended fields have a smaller record size
+    FILE* f = fopen(file, "rb");
+    if(f == NULL)
+        return 0;
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    long stride = size / 256;
+    fseek(f, 0, SEEK_SET);
+    if(stride > (long)sizeof(struct ssynth))
+        stride = sizeof(struct ssynth);
+    int r = size % 256 == 0 && stride >= (long)offsetof(struct ssynth, unison_state) ? 1 : -1;
+    for(int i = 0; i < 256 && r == 1; i++)
     {
-        if(input2_fmmod == 1)
-            f *= input2;
-        else if(input2_fmmod == 2)
-            t *= squish(input2);
-        else if(input2_fmmod == 3)
-            r *= squish(input2);
+        memset(&banks[i], 0x00, sizeof(struct ssynth));
+        if(fread(&banks[i], stride, 1, f) != 1)
+            r = -1;
     }
+    fclose(f);
+    return r;
+}
 
-    // am modulation inputs
-    if(input1_ammod != 0)
+struct ssynth* readLibrary(const char* file, Uint32* count)
+{
+    // every bank of a library of either format, NULL when it is neither
+    struct sstore lib;
+    struct ssynth* banks = NULL;
+    if(storeOpen(&lib, file, BANK_FORMAT, BANK_RECORD) == 1)
     {
-        if(input1_ammod == 1)
-            a *= input1;
-        else if(input1_ammod == 2)
-            r *= squish(input1);
-        else if(input1_ammod == 3)
-            t *= squish(input1);
+        banks = malloc((size_t)lib.count * sizeof(struct ssynth) + 1);
+        for(Uint32 i = 0; i < lib.count && banks != NULL; i++)
+            if(bankDecode(lib.base + (size_t)i * BANK_RECORD, &banks[i]) < 0)
+                blankBank(&banks[i]);
+    }
+    else if(storeOpen(&lib, file, 0, sizeof(struct ssynth)) == 1)
+    {
+        banks = malloc((size_t)lib.count * sizeof(struct ssynth) + 1);
+        if(banks != NULL)
+            memcpy(banks, lib.base, (size_t)lib.count * sizeof(struct ssynth));
     }
+    else
+        return NULL;
+    *count = lib.count;
+    storeClose(&lib);
+    return banks;
+}
 
-    if(input2_ammod != 0)
+int addBanks(const struct ssynth* banks, Uint32 n)
+{
+    // appended to the file straight away, decoded when they are selected
+    Uint32* flags = malloc(n*4 + 4);
+    Uint8* records = flags != NULL ? encodeBanks(banks, n, flags) : NULL;
+    libraryLock();
+    int r = records != NULL ? storeAppend(&store, records, flags, n) : -1;
+    if(r == 1)
+        r = bankRoom(store.count);
+    libraryUnlock();
+    free(records);
+    free(flags);
+    return r;
+}
+
+int addBank()
+{
+    struct ssynth blank;
+    blankBank(&blank);
+    return addBanks(&blank, 1);
+}
+
+int importBanks(const char* file)
+{
+    // the used banks of another library or of a bank.save
+    Uint32 count = 256, n = 0;
+    struct ssynth* banks = readLibrary(file, &count);
+    int r = banks != NULL ? 1 : -1;
+    if(banks == NULL)
     {
-        if(input2_ammod == 1)
-            a *= input2;
-        else if(input2_ammod == 2)
-            r *= squish(input2);
-        else if(input2_ammod == 3)
-            t *= squish(input2);
+        banks = malloc(256 * sizeof(struct ssynth));
+        if(banks != NULL && loadLegacy(file, banks) == 1)
+            r = 1;
     }
+    for(Uint32 i = 0; i < count && r == 1; i++)
+        if(recordUsed(&banks[i]) == 1)
+            banks[n++] = banks[i];
+    if(r == 1)
+        r = addBanks(banks, n);
+    free(banks);
+    if(r < 0)
+        printf("%s could not be imported.\n", file);
+    else
+        printf("Imported %u banks from %s.\n", n, file);
+    return r;
+}
 
-    // oscid correction (because oscid should start from 0 and not 1 for oscphase index)
-    oscid -= 1;
+void openLibrary()
+{
+    char file[256];
+    if(library_path != NULL)
+        snprintf(file, sizeof(file), "%s", library_path);
+    else
+        snprintf(file, sizeof(file), "%sbanks.lib", appdir);
 
-    // blending between shapes
-    if(t <= 0.1666666716f)
+    if(storeOpen(&store, file, BANK_FORMAT, BANK_RECORD) < 0)
     {
-        float d1 = 0.1666666716f - t;
-        float d2 = 0.1666666716f - d1;
-        d1 *= 6.f;
-        d2 *= 6.f;
-        o = (aliased_sin(oscphase[oscid]) * a) * d1;
-        if(t > 0)
+        // a library of raw records is converted
+        Uint32 count = 256;
+        struct ssynth* banks = readLibrary(file, &count);
+        Uint8 create = banks != NULL;
+        if(banks != NULL)
+            printf("Converting the %u banks of %s to format %d.\n", count, file, BANK_FORMAT);
+        else
         {
-            float tr, rb, rd;
-            modff(r, &rb);
-            rd = r-rb;
-            if(r < 29.f && rd > 0.f)
+            banks = malloc(256 * sizeof(struct ssynth));
+            if(banks == NULL)
             {
-                tr =  getSlantSine(oscphase[oscid], rb) * (1.f-rd);
-                tr += getSlantSine(oscphase[oscid], rb+1.f) * rd;
+                printf("Out of memory for the banks.\n");
+                exit(1);
+            }
+            for(int i = 0; i < 256; i++)
+                blankBank(&banks[i]);
+
+            FILE* f = fopen(file, "rb");
+            if(f != NULL)
+            {
+                // never written over, the banks are blank and saving is off
+                fclose(f);
+                printf("Loading %s totally failed. ¯\\_(ツ)_/¯ Maybe it's corrupted? :(\n", file);
             }
             else
             {
-                tr = getSlantSine(oscphase[oscid], r);
+                // a new library, from bank.save when there is one
+                char legacy[256];
+                sprintf(legacy, "%sbank.save", appdir);
+                int l = library_path == NULL ? loadLegacy(legacy, banks) : 0;
+                if(l == 0 && library_path == NULL)
+                {
+                    // a save that was interrupted between the remove and the rename
+                    sprintf(legacy, "%sbank.save.tmp", appdir);
+                    l = loadLegacy(legacy, banks);
+                }
+                if(l < 0)
+                    printf("Loading your data totally failed. ¯\\_(ツ)_/¯ Maybe it's corrupted? :(\n");
+                create = 1;
             }
-            o += (tr * a) * d2;
         }
+
+        int r = -1;
+        Uint32* flags = malloc(count*4 + 4);
+        Uint8* records = flags != NULL ? encodeBanks(banks, count, flags) : NULL;
+        if(records == NULL)
+        {
+            printf("Out of memory for the banks.\n");
+            exit(1);
+        }
+        if(create == 1 && storeCreate(file, BANK_FORMAT, BANK_RECORD, records, flags, count) == 1)
+            r = storeOpen(&store, file, BANK_FORMAT, BANK_RECORD);
+        if(create == 1 && r < 0)
+            printf("%s could not be written, changes will not be saved.\n", file);
+        if(r < 0)
+        {
+            storeMemory(&store, BANK_FORMAT, BANK_RECORD, records, count);
+            memcpy(store.index, flags, count*4);
+        }
+        free(records);
+        free(flags);
+        free(banks);
     }
-    else if(t <= 0.3333333433f)
+    if(store.recovered > 0)
+        printf("Recovered %u banks from an interrupted save.\n", store.recovered);
+    if(bankRoom(store.count) < 0)
     {
-        float d1 = 0.1666666716f - (t - 0.1666666716f);
-        float d2 = 0.1666666716f - d1;
+        printf("Out of memory for the banks.\n");
+        exit(1);
+    }
+    bankLoad(selected_bank);
+}
+
+void saveState()
+{
+    // the dirty banks are encoded with their index flags and decoded again, what is heard is what is saved
+    libraryLock();
+    for(Uint32 i = 0; i < store.count; i++)
+    {
+        if(store.dirty[i] == 0 || storeIntact(&store) == 0)
+            continue;
+        Uint8* r = store.base + (size_t)i * BANK_RECORD;
+        bankEncode(&synth[i], r);
+        bankDecode(r, &synth[i]);
+        store.index[i] = recordUsed(&synth[i]) == 1 ? STORE_USED : 0;
+    }
+    if(storeSave(&store) < 0)
+        printf("Saving failed, %s is unchanged.\n", store.path[0] != 0x00 ? store.path : "the library");
+    libraryUnlock();
+}
+
+void loadState()
+{
+    // the first load opens the library, later ones put back the banks changed since the last save
+    if(synth == NULL)
+    {
+        openLibrary();
+        return;
+    }
+    libraryLock();
+    for(Uint32 i = 0; i < store.count; i++)
+        if(store.dirty[i] == 1)
+            bank_ready[i] = 0;
+    storeRevert(&store);
+    bankLoad(selected_bank);
+    libraryUnlock();
+}
+
+Sint32 dialOscillator(Uint32 dial)
+{
+    // oscillator index (oscid-1) that a dial belongs to
+    if(dial < 16)
+        return 4 + (dial / 4);
+    else if(dial < 32)
+        return (dial - 16) / 4;
+    return -1;
+}
+
+float dialScale(Uint32 dial)
+{
+    // resolution dials of hi-res oscillators have a larger range
+    if(dial < 32 && dial % 4 == 2 && synth[selected_bank].hires_state[dialOscillator(dial)] == 1)
+        return MAXHIRES;
+    return dial_scale[dial];
+}
+
+/*
+    control-rate modulation bus
+
+    The modulators are evaluated once per MODBLOCK samples and the
+    dials they target are linearly interpolated in between, so slow
+    movement costs an add per sample instead of an audio oscillator.
+*/
+const char* mod_names[] = {"Off", "Sine", "Triangle", "Saw", "Square", "Rise", "Fall"};
+// the render state is _Thread_local, export workers each render their own bank
+_Thread_local float dial_value[50];     // scaled dial values used by the render
+_Thread_local float mod_step[50];       // per-sample increments of modulated dials
+_Thread_local Uint8 mod_dial[50];       // modulated dial indices
+_Thread_local Uint32 mod_dials = 0;
+_Thread_local float transpose = 1.f;    // oscillator frequency ratio, set for multisample notes
+
+float modRate(float rate)
+{
+    return 0.05f + (rate * rate * MAXMODRATE);
+}
+
+float getModulator(Uint32 type, float rate, double time)
+{
+    // the cycles are counted in double, only the phase within one is a float
+    const double x = time * modRate(rate);
+    const float f = x - floor(x);
+    if(type == 1)
+        return sinf(f * 6.283185482f);
+    else if(type == 2)
+        return 1.f - (fabsf(f - 0.5f) * 4.f);
+    else if(type == 3)
+        return (f * 2.f) - 1.f;
+    else if(type == 4)
+        return f < 0.5f ? 1.f : -1.f;
+    else if(type == 5)
+        return x < 1.f ? x : 1.f;
+    else if(type == 6)
+        return x < 1.f ? 1.f - x : 0.f;
+    return 0.f;
+}
+
+float getModulatedDial(Uint32 dial, double time)
+{
+    float v = synth[selected_bank].dial_state[dial];
+    for(int i = 0; i < MODSLOTS; i++)
+        if(synth[selected_bank].mod_type[i] != 0 && synth[selected_bank].mod_target[i] == dial)
+            v += getModulator(synth[selected_bank].mod_type[i], synth[selected_bank].mod_rate[i], time) * synth[selected_bank].mod_depth[i];
+
+    // limit
+    if(v > 1.f)
+        v = 1.f;
+    else if(dial_neg[dial] == 1 && v < -1.f)
+        v = -1.f;
+    else if(dial_neg[dial] == 0 && v < 0.f)
+        v = 0.f;
+
+    if(dial < 32 && dial % 4 == 0)
+        return v * dialScale(dial) * transpose;
+    return v * dialScale(dial);
+}
+
+Sint32 getModSlot(Uint32 dial, Uint8 alloc)
+{
+    for(int i = 0; i < MODSLOTS; i++)
+        if(synth[selected_bank].mod_type[i] != 0 && synth[selected_bank].mod_target[i] == dial)
+            return i;
+
+    if(alloc == 1)
+    {
+        for(int i = 0; i < MODSLOTS; i++)
+        {
+            if(synth[selected_bank].mod_type[i] == 0)
+            {
+                synth[selected_bank].mod_type[i] = 1;
+                synth[selected_bank].mod_target[i] = dial;
+                synth[selected_bank].mod_rate[i] = 0.2f;
+                synth[selected_bank].mod_depth[i] = 0.f;
+                markDirty(selected_bank);
+                return i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+_Thread_local Uint32 crush_len = 0;
+void updateModulation(Uint32 i)
+{
+    // interpolate towards the modulated values at the end of this block
+    const double t = (double)(i + MODBLOCK) / (double)SAMPLE_RATE; // seconds, a float would drift on long streams
+    for(int j = 0; j < mod_dials; j++)
+    {
+        const Uint32 d = mod_dial[j];
+        mod_step[d] = (getModulatedDial(d, t) - dial_value[d]) * (1.f / MODBLOCK);
+        if(d == 49)
+            crush_len = dial_value[49] * 33;
+    }
+}
+
+void resetModulation()
+{
+    mod_dials = 0;
+    for(int i = 0; i < MODSLOTS; i++)
+    {
+        if(synth[selected_bank].mod_type[i] == 0)
+            continue;
+
+        const Uint32 d = synth[selected_bank].mod_target[i];
+        Uint8 dup = 0;
+        for(int j = 0; j < mod_dials; j++)
+            if(mod_dial[j] == d)
+                dup = 1;
+        if(dup == 0)
+        {
+            mod_dial[mod_dials] = d;
+            mod_dials++;
+            dial_value[d] = getModulatedDial(d, 0.f);
+        }
+    }
+}
+
+_Thread_local float oscphase[8] = {0.f}; // oscillator phases
+
+// unison stacks, one lane per voice
+_Thread_local v8f uniphase[8];  // lane phases
+_Thread_local v8f uniratio[8];  // lane detune frequency ratios
+_Thread_local v8f unigain[8];   // lane mix gains (0 for unused lanes)
+
+V8_INLINE v8f getGenerator8(const v8f* phase, Uint32 shape, float r)
+{
+    if(shape == 1)
+        return getSlantSine8(phase, r);
+    else if(shape == 2)
+        return getSquare8(phase, r);
+    else if(shape == 3)
+        return getSawtooth8(phase, r);
+    else if(shape == 4)
+        return getTriangle8(phase, r);
+    else if(shape == 5)
+        return getBipulse8(phase, r);
+    return getViolin8(phase, r);
+}
+
+V8_INLINE v8f getShape8(const v8f* phase, Uint32 shape, float r)
+{
+    if(shape == 0)
+        return aliased_sin8(phase, 1.f, 0.f);
+
+    float rb, rd;
+    modff(r, &rb);
+    rd = r-rb;
+    if(r < 29.f && rd > 0.f)
+        return getGenerator8(phase, shape, rb) * (1.f-rd) + getGenerator8(phase, shape, rb+1.f) * rd;
+    return getGenerator8(phase, shape, r);
+}
+
+float doUnison(Uint32 oscid, float f, float a, float r, float t)
+{
+    // same shape blend as doOsc, on all lanes at once
+    float ts = t * 6.f;
+    if(ts < 0.f){ts = 0.f;}
+    Uint32 shape = ts;
+    if(shape > 5){shape = 5;}
+    const float d2 = ts - (float)shape;
+    const float d1 = 1.f - d2;
+
+    v8f o = getShape8(&uniphase[oscid], shape, r) * (a * d1);
+    if(d2 > 0.f)
+        o += getShape8(&uniphase[oscid], shape+1, r) * (a * d2);
+    o *= unigain[oscid];
+
+    // step lane phases
+    const v8f p = uniphase[oscid] + uniratio[oscid] * (Hz(f)*reciprocal_sample_rate);
+    uniphase[oscid] = wrapPhase8(&p);
+
+    return o[0] + o[1] + o[2] + o[3] + o[4] + o[5] + o[6] + o[7];
+}
+
+void resetUnison()
+{
+    for(int i = 0; i < 8; i++)
+    {
+        const Uint32 n = synth[selected_bank].unison_state[i] + 1;
+        const float detune = synth[selected_bank].detune_state[i] * MAXDETUNE;
+        const float spread = synth[selected_bank].spread_state[i] * 6.283185482f;
+        for(int j = 0; j < 8; j++)
+        {
+            uniphase[i][j] = 0.f;
+            uniratio[i][j] = 1.f;
+            unigain[i][j] = 0.f;
+            if(j < n)
+            {
+                // voices fan out evenly across -detune to +detune cents,
+                // the sum is normalised so zero detune equals one voice
+                if(n > 1)
+                {
+                    const float pos = ((float)j / (float)(n-1)) * 2.f - 1.f;
+                    uniratio[i][j] = exp2f((pos * detune) * 0.000833333354f); // 1/1200
+                    uniphase[i][j] = (spread * (float)j) / (float)n;
+                }
+                unigain[i][j] = 1.f / (float)n;
+            }
+        }
+    }
+}
+
+/*
+    hi-res (IFFT) oscillators
+
+    Above MAXRESOLUTION the per-sample additive cost would grow with
+    every harmonic, so once per HIRES_HOP the blended shape's harmonic
+    amplitudes are written into a spectrum and one real IFFT turns it
+    into a single period table. Consecutive frames are overlap-added
+    with a linear crossfade, the harmonics are cut at nyquist.
+*/
+struct shires
+{
+    float table[2][HIRES_TABLE+1]; // +1 guard sample for interpolation
+    Uint32 cur;     // table being faded in
+    Uint32 hop;     // samples until the next frame
+    Uint32 fade;    // samples left in the crossfade
+    float r, t;     // shape of the current table, r < 0 forces a rebuild
+    Uint32 kmax;
+};
+_Thread_local struct shires hires[8];
+struct sfft hires_fft;
+_Thread_local float hires_re[HIRES_TABLE/2+1];
+_Thread_local float hires_im[HIRES_TABLE/2+1];
+
+void addShapeHarmonics(Uint32 shape, float r, float w, float* re, float* im, Uint32 kmax)
+{
+    // x = sum(s_k sin(k phase) + c_k cos(k phase)) needs im_k -= s_k, re_k += c_k
+    if(shape == 0) // sine
+    {
+        im[1] -= w;
+    }
+    else if(shape == 1) // slant sine
+    {
+        im[1] -= w;
+        for(Uint32 k = 3; (float)k < r && k <= kmax; k++)
+            im[k] -= w / (float)(k*k);
+    }
+    else if(shape == 2) // square
+    {
+        im[1] -= w;
+        for(Uint32 k = 3; (float)k < r*2.f && k <= kmax; k+=2)
+            im[k] -= w / (float)k;
+    }
+    else if(shape == 3) // sawtooth
+    {
+        im[1] -= w;
+        for(Uint32 k = 2; (float)k <= r && k <= kmax; k++)
+            im[k] -= w / (float)k;
+    }
+    else if(shape == 4) // triangle
+    {
+        im[1] -= w;
+        float sign = -1.f;
+        for(Uint32 k = 3; (float)k <= r*2.f && k <= kmax; k+=2)
+        {
+            im[k] -= (w / (float)(k*k)) * sign;
+            sign *= -1.f;
+        }
+    }
+    else if(shape == 5) // formant
+    {
+        for(Uint32 k = 1; (float)k <= r && k <= kmax; k++)
+        {
+            const float d = ((float)k - 5.f) * 0.5f;
+            im[k] -= (expf(-d * d) / (float)k) * w;
+        }
+    }
+    else // impulse
+    {
+        for(Uint32 h = 0; h < 10 && h < kmax; h++)
+        {
+            const float step = h * 3.f;
+            if(r > step)
+            {
+                float amp = vamps[h] * w;
+                if(r < step + 3.f)
+                    amp *= (r - step) * 0.33333333333333333333f;
+                if(h % 2 == 0)
+                    im[h+1] -= amp;
+                else
+                    re[h+1] += amp;
+            }
+        }
+    }
+}
+
+void buildHires(float* table, float r, float t, Uint32 kmax)
+{
+    memset(hires_re, 0x00, sizeof(hires_re));
+    memset(hires_im, 0x00, sizeof(hires_im));
+
+    // same shape blend as doOsc
+    float ts = t * 6.f;
+    if(ts < 0.f){ts = 0.f;}
+    Uint32 shape = ts;
+    if(shape > 5){shape = 5;}
+    const float d2 = ts - (float)shape;
+    const float d1 = 1.f - d2;
+
+    // interpolate fractional resolutions, scaled for the normalised IFFT
+    float rb, rd;
+    modff(r, &rb);
+    rd = r-rb;
+    const float w = HIRES_TABLE * 0.5f;
+    addShapeHarmonics(shape, rb, w*d1*(1.f-rd), hires_re, hires_im, kmax);
+    addShapeHarmonics(shape, rb+1.f, w*d1*rd, hires_re, hires_im, kmax);
+    if(d2 > 0.f)
+    {
+        addShapeHarmonics(shape+1, rb, w*d2*(1.f-rd), hires_re, hires_im, kmax);
+        addShapeHarmonics(shape+1, rb+1.f, w*d2*rd, hires_re, hires_im, kmax);
+    }
+
+    ifftReal(&hires_fft, hires_re, hires_im, table);
+    table[HIRES_TABLE] = table[0];
+}
+
+void resetHires()
+{
+    for(int i = 0; i < 8; i++)
+    {
+        hires[i].hop = 0;
+        hires[i].fade = 0;
+        hires[i].r = -1.f;
+    }
+}
+
+float lookupHires(const float* table, float phase)
+{
+    const float p = phase * 651.8986469f; // HIRES_TABLE / x2PIf
+    const float pf = floorf(p);
+    const Uint32 i = ((Sint32)pf) & (HIRES_TABLE-1);
+    return table[i] + (table[i+1] - table[i]) * (p - pf);
+}
+
+float doHires(Uint32 oscid, float f, float a, float r, float t)
+{
+    struct shires* h = &hires[oscid];
+
+    // new frame, the table is only rebuilt if the shape changed
+    if(h->hop == 0)
+    {
+        h->hop = HIRES_HOP;
+        Uint32 kmax = HIRES_TABLE/4;
+        const float nyquist = (SAMPLE_RATE * 0.5f) / fabsf(f);
+        if(nyquist < kmax)
+            kmax = nyquist < 1.f ? 1 : nyquist;
+        if(r != h->r || t != h->t || kmax != h->kmax)
+        {
+            h->fade = h->r < 0.f ? 0 : HIRES_HOP;
+            h->cur ^= 1;
+            buildHires(h->table[h->cur], r, t, kmax);
+            h->r = r, h->t = t, h->kmax = kmax;
+        }
+    }
+    h->hop--;
+
+    const float* cur = h->table[h->cur];
+    const float* prev = h->table[h->cur ^ 1];
+    const float w = (float)h->fade * (1.f / HIRES_HOP);
+    if(h->fade > 0)
+        h->fade--;
+
+    // unison lanes share the frame tables
+    float o = 0.f;
+    if(synth[selected_bank].unison_state[oscid] > 0)
+    {
+        for(int j = 0; j < 8; j++)
+        {
+            if(unigain[oscid][j] == 0.f)
+                continue;
+            float u = lookupHires(cur, uniphase[oscid][j]);
+            if(w > 0.f)
+                u += (lookupHires(prev, uniphase[oscid][j]) - u) * w;
+            o += u * unigain[oscid][j];
+        }
+        const v8f p = uniphase[oscid] + uniratio[oscid] * (Hz(f)*reciprocal_sample_rate);
+        uniphase[oscid] = wrapPhase8(&p);
+    }
+    else
+    {
+        o = lookupHires(cur, oscphase[oscid]);
+        if(w > 0.f)
+            o += (lookupHires(prev, oscphase[oscid]) - o) * w;
+    }
+
+    return o * a;
+}
+
+float doOsc(Uint32 oscid, float input1, float input2)
+{
+    float o = 0.f;
+    float f = 0.f, a = 0.f, r = 0.f, t = 0.f;
+    Uint8 input1_fmmod = 0, input1_ammod = 0, input1_mod = 0;
+    Uint8 input2_fmmod = 0, input2_ammod = 0, input2_mod = 0;
+
+    // load selected oscillator dial values with scaling
+    if(oscid == 1)
+    {
+        f = dial_value[16];
+        a = dial_value[17];
+        r = dial_value[18];
+        t = dial_value[19];
+
+        input1_ammod = synth[selected_bank].am_state[9];
+        input1_mod = synth[selected_bank].mul_state[9];
+        input1_fmmod = synth[selected_bank].fm_state[9];
+
+        input2_ammod = synth[selected_bank].am_state[8];
+        input2_mod = synth[selected_bank].mul_state[8];
+        input2_fmmod = synth[selected_bank].fm_state[8];
+    }
+    else if(oscid == 2)
+    {
+        // are any outputs enabled?
+        if(synth[selected_bank].am_state[8] + synth[selected_bank].mul_state[8] + synth[selected_bank].fm_state[8] == 0){return 0.f;}
+
+        f = dial_value[20];
+        a = dial_value[21];
+        r = dial_value[22];
+        t = dial_value[23];
+
+        input1_ammod = synth[selected_bank].am_state[6];
+        input1_mod = synth[selected_bank].mul_state[6];
+        input1_fmmod = synth[selected_bank].fm_state[6];
+
+        input2_ammod = synth[selected_bank].am_state[5];
+        input2_mod = synth[selected_bank].mul_state[5];
+        input2_fmmod = synth[selected_bank].fm_state[5];
+    }
+    else if(oscid == 3)
+    {
+        // are any outputs enabled?
+        if(synth[selected_bank].am_state[5] + synth[selected_bank].mul_state[5] + synth[selected_bank].fm_state[5] == 0){return 0.f;}
+
+        f = dial_value[24];
+        a = dial_value[25];
+        r = dial_value[26];
+        t = dial_value[27];
+
+        input1_ammod = synth[selected_bank].am_state[3];
+        input1_mod = synth[selected_bank].mul_state[3];
+        input1_fmmod = synth[selected_bank].fm_state[3];
+
+        input2_ammod = synth[selected_bank].am_state[2];
+        input2_mod = synth[selected_bank].mul_state[2];
+        input2_fmmod = synth[selected_bank].fm_state[2];
+    }
+    else if(oscid == 4)
+    {
+        // are any outputs enabled?
+        if(synth[selected_bank].am_state[2] + synth[selected_bank].mul_state[2] + synth[selected_bank].fm_state[2] == 0){return 0.f;}
+
+        f = dial_value[28];
+        a = dial_value[29];
+        r = dial_value[30];
+        t = dial_value[31];
+
+        input1_ammod = synth[selected_bank].am_state[0];
+        input1_mod = synth[selected_bank].mul_state[0];
+        input1_fmmod = synth[selected_bank].fm_state[0];
+
+        input2_ammod = 0;
+        input2_mod = 0;
+        input2_fmmod = 0;
+    }
+    else if(oscid == 5)
+    {
+        // are any outputs enabled?
+        if(synth[selected_bank].am_state[9] + synth[selected_bank].mul_state[9] + synth[selected_bank].fm_state[9] == 0){return 0.f;}
+
+        f = dial_value[0];
+        a = dial_value[1];
+        r = dial_value[2];
+        t = dial_value[3];
+        
+        input1_ammod = synth[selected_bank].am_state[7];
+        input1_mod = synth[selected_bank].mul_state[7];
+        input1_fmmod = synth[selected_bank].fm_state[7];
+
+        input2_ammod = 0;
+        input2_mod = 0;
+        input2_fmmod = 0;
+    }
+    else if(oscid == 6)
+    {
+        // are any outputs enabled?
+        if( synth[selected_bank].am_state[6] + synth[selected_bank].mul_state[6] + synth[selected_bank].fm_state[6] +
+            synth[selected_bank].am_state[7] + synth[selected_bank].mul_state[7] + synth[selected_bank].fm_state[7] == 0){return 0.f;}
+
+        f = dial_value[4];
+        a = dial_value[5];
+        r = dial_value[6];
+        t = dial_value[7];
+
+        input1_ammod = synth[selected_bank].am_state[4];
+        input1_mod = synth[selected_bank].mul_state[4];
+        input1_fmmod = synth[selected_bank].fm_state[4];
+
+        input2_ammod = 0;
+        input2_mod = 0;
+        input2_fmmod = 0;
+    }
+    else if(oscid == 7)
+    {
+        // are any outputs enabled?
+        if( synth[selected_bank].am_state[3] + synth[selected_bank].mul_state[3] + synth[selected_bank].fm_state[3] +
+            synth[selected_bank].am_state[4] + synth[selected_bank].mul_state[4] + synth[selected_bank].fm_state[4] == 0){return 0.f;}
+
+        f = dial_value[8];
+        a = dial_value[9];
+        r = dial_value[10];
+        t = dial_value[11];
+
+        input1_ammod = synth[selected_bank].am_state[1];
+        input1_mod = synth[selected_bank].mul_state[1];
+        input1_fmmod = synth[selected_bank].fm_state[1];
+
+        input2_ammod = 0;
+        input2_mod = 0;
+        input2_fmmod = 0;
+    }
+    else if(oscid == 8)
+    {
+        // are any outputs enabled?
+        if( synth[selected_bank].am_state[0] + synth[selected_bank].mul_state[0] + synth[selected_bank].fm_state[0] +
+            synth[selected_bank].am_state[1] + synth[selected_bank].mul_state[1] + synth[selected_bank].fm_state[1] == 0){return 0.f;}
+
+        f = dial_value[12];
+        a = dial_value[13];
+        r = dial_value[14];
+        t = dial_value[15];
+
+        input1_ammod = 0;
+        input1_mod = 0;
+        input1_fmmod = 0;
+
+        input2_ammod = 0;
+        input2_mod = 0;
+        input2_fmmod = 0;
+    }
+
+    // fm modulation inputs
+    if(input1_fmmod != 0)
+    {
+        if(input1_fmmod == 1)
+            f *= input1;
+        else if(input1_fmmod == 2)
+            t *= squish(input1);
+        else if(input1_fmmod == 3)
+            r *= squish(input1);
+    }
+
+    if(input2_fmmod != 0)
+    {
+        if(input2_fmmod == 1)
+            f *= input2;
+        else if(input2_fmmod == 2)
+            t *= squish(input2);
+        else if(input2_fmmod == 3)
+            r *= squish(input2);
+    }
+
+    // am modulation inputs
+    if(input1_ammod != 0)
+    {
+        if(input1_ammod == 1)
+            a *= input1;
+        else if(input1_ammod == 2)
+            r *= squish(input1);
+        else if(input1_ammod == 3)
+            t *= squish(input1);
+    }
+
+    if(input2_ammod != 0)
+    {
+        if(input2_ammod == 1)
+            a *= input2;
+        else if(input2_ammod == 2)
+            r *= squish(input2);
+        else if(input2_ammod == 3)
+            t *= squish(input2);
+    }
+
+    // oscid correction (because oscid should start from 0 and not 1 for oscphase index)
+    oscid -= 1;
+
+    // dropping back to the additive path restarts the hi-res frames
+    if(synth[selected_bank].hires_state[oscid] == 1 && r <= MAXRESOLUTION)
+        hires[oscid].hop = 0, hires[oscid].r = -1.f;
+
+    // blending between shapes
+    if(synth[selected_bank].hires_state[oscid] == 1 && r > MAXRESOLUTION)
+    {
+        o = doHires(oscid, f, a, r, t);
+    }
+    else if(synth[selected_bank].unison_state[oscid] > 0)
+    {
+        o = doUnison(oscid, f, a, r, t);
+    }
+    else if(t <= 0.1666666716f)
+    {
+        float d1 = 0.1666666716f - t;
+        float d2 = 0.1666666716f - d1;
+        d1 *= 6.f;
+        d2 *= 6.f;
+        o = (aliased_sin(oscphase[oscid]) * a) * d1;
+        if(t > 0)
+        {
+            float tr, rb, rd;
+            modff(r, &rb);
+            rd = r-rb;
+            if(r < 29.f && rd > 0.f)
+            {
+                tr =  getSlantSine(oscphase[oscid], rb) * (1.f-rd);
+                tr += getSlantSine(oscphase[oscid], rb+1.f) * rd;
+            }
+            else
+            {
+                tr = getSlantSine(oscphase[oscid], r);
+            }
+            o += (tr * a) * d2;
+        }
+    }
+    else if(t <= 0.3333333433f)
+    {
+        float d1 = 0.1666666716f - (t - 0.1666666716f);
+        float d2 = 0.1666666716f - d1;
+        d1 *= 6.f;
+        d2 *= 6.f;
+
+        float tr, rb, rd;
+        modff(r, &rb);
+        rd = r-rb;
+
+        if(r < 29.f && rd > 0.f)
+        {
+            tr =  getSlantSine(oscphase[oscid], rb) * (1.f-rd);
+            tr += getSlantSine(oscphase[oscid], rb+1.f) * rd;
+        }
+        else
+        {
+            tr = getSlantSine(oscphase[oscid], r);
+        }
+        o = (tr * a) * d1;
+
+        if(t > 0.1666666716f)
+        {
+            if(r < 29.f && rd > 0.f)
+            {
+                tr =  getSquare(oscphase[oscid], rb) * (1.f-rd);
+                tr += getSquare(oscphase[oscid], rb+1.f) * rd;
+            }
+            else
+            {
+                tr = getSquare(oscphase[oscid], r);
+            }
+            o += (tr * a) * d2;
+        }
+    }
+    else if(t <= 0.50f)
+    {
+        float d1 = 0.1666666716f - (t - 0.3333333433f);
+        float d2 = 0.1666666716f - d1;
+        d1 *= 6.f;
+        d2 *= 6.f;
+
+        float tr, rb, rd;
+        modff(r, &rb);
+        rd = r-rb;
+
+        if(r < 29.f && rd > 0.f)
+        {
+            tr =  getSquare(oscphase[oscid], rb) * (1.f-rd);
+            tr += getSquare(oscphase[oscid], rb+1.f) * rd;
+        }
+        else
+        {
+            tr = getSquare(oscphase[oscid], r);
+        }
+        o = (tr * a) * d1;
+
+        if(t > 0.3333333433f)
+        {
+            if(r < 29.f && rd > 0.f)
+            {
+                tr =  getSawtooth(oscphase[oscid], rb) * (1.f-rd);
+                tr += getSawtooth(oscphase[oscid], rb+1.f) * rd;
+            }
+            else
+            {
+                tr = getSawtooth(oscphase[oscid], r);
+            }
+            o += (tr * a) * d2;
+        }
+    }
+    else if(t <= 0.6666666865f)
+    {
+        float d1 = 0.1666666716f - (t - 0.50f);
+        float d2 = 0.1666666716f - d1;
+        d1 *= 6.f;
+        d2 *= 6.f;
+
+        float tr, rb, rd;
+        modff(r, &rb);
+        rd = r-rb;
+
+        if(r < 29.f && rd > 0.f)
+        {
+            tr =  getSawtooth(oscphase[oscid], rb) * (1.f-rd);
+            tr += getSawtooth(oscphase[oscid], rb+1.f) * rd;
+        }
+        else
+        {
+            tr = getSawtooth(oscphase[oscid], r);
+        }
+        o = (tr * a) * d1;
+        
+        if(t > 0.50f)
+        {
+            if(r < 29.f && rd > 0.f)
+            {
+                tr =  getTriangle(oscphase[oscid], rb) * (1.f-rd);
+                tr += getTriangle(oscphase[oscid], rb+1.f) * rd;
+            }
+            else
+            {
+                tr = getTriangle(oscphase[oscid], r);
+            }
+            o += (tr * a) * d2;
+        }
+    }
+    else if(t <= 0.8333333731f)
+    {
+        float d1 = 0.1666666716f - (t - 0.6666666865f);
+        float d2 = 0.1666666716f - d1;
         d1 *= 6.f;
         d2 *= 6.f;
 
-        float tr, rb, rd;
-        modff(r, &rb);
-        rd = r-rb;
+        float tr, rb, rd;
+        modff(r, &rb);
+        rd = r-rb;
+
+        if(r < 29.f && rd > 0.f)
+        {
+            tr =  getTriangle(oscphase[oscid], rb) * (1.f-rd);
+            tr += getTriangle(oscphase[oscid], rb+1.f) * rd;
+        }
+        else
+        {
+            tr = getTriangle(oscphase[oscid], r);
+        }
+        o = (tr * a) * d1;
+        
+        if(t > 0.6666666865f)
+        {
+            if(r < 29.f && rd > 0.f)
+            {
+                tr =  getBipulse(oscphase[oscid], rb) * (1.f-rd);
+                tr += getBipulse(oscphase[oscid], rb+1.f) * rd;
+            }
+            else
+            {
+                tr = getBipulse(oscphase[oscid], r);
+            }
+            o += (tr * a) * d2;
+        }
+    }
+    else
+    {
+        float d1 = 0.1666666716f - (t - 0.8333333731f);
+        float d2 = 0.1666666716f - d1;
+        d1 *= 6.f;
+        d2 *= 6.f;
+
+        float tr, rb, rd;
+        modff(r, &rb);
+        rd = r-rb;
+
+        if(r < 29.f && rd > 0.f)
+        {
+            tr =  getBipulse(oscphase[oscid], rb) * (1.f-rd);
+            tr += getBipulse(oscphase[oscid], rb+1.f) * rd;
+        }
+        else
+        {
+            tr = getBipulse(oscphase[oscid], r);
+        }
+        o = (tr * a) * d1;
+        
+        if(t > 0.8333333731f)
+        {
+            if(r < 29.f && rd > 0.f)
+            {
+                tr =  getViolin(oscphase[oscid], rb) * (1.f-rd);
+                tr += getViolin(oscphase[oscid], rb+1.f) * rd;
+            }
+            else
+            {
+                tr = getViolin(oscphase[oscid], r);
+            }
+            o += (tr * a) * d2;
+        }
+    }
+
+    // add/sub/mul modulation inputs
+    if(input1_mod != 0)
+    {
+        if(input1_mod == 1)
+            o += input1;
+        else if(input1_mod == 2)
+            o -= input1;
+        else if(input1_mod == 3)
+            o *= input1;
+    }
+
+    if(input2_mod != 0)
+    {
+        if(input2_mod == 1)
+            o += input2;
+        else if(input2_mod == 2)
+            o -= input2;
+        else if(input2_mod == 3)
+            o *= input2;
+    }
+
+    // step oscillator phase
+    oscphase[oscid] = wrapPhase(oscphase[oscid] + Hz(f)*reciprocal_sample_rate);
+
+    // return output
+    return o;
+}
+
+/*
+    envelope ramps
+
+    Each of the 465 envelope segments is expanded once per render into
+    a cubic in the sample position within the segment, linear or hermite
+    (laurent de soras) with the same per-sample cost, so the render only
+    evaluates the polynomial for whole runs of samples at a time.
+*/
+struct sramp
+{
+    float c0, c1, c2, c3;
+};
+_Thread_local struct sramp env_ramp[466];
+
+_Thread_local Uint32 eic = 0;
+_Thread_local Uint32 samstep = 0;
+_Thread_local Uint32 render_len = 0; // samples in the render, beyond sample_len when streaming
+_Thread_local Uint32 envelope_offset = 0;
+_Thread_local Uint32 crush_index = 0;
+_Thread_local float  crush_value = 0.f;
+_Thread_local struct sbiquads biquads;
+
+void buildEnvelope()
+{
+    const float* e = synth[selected_bank].envelope;
+    samstep = render_len / 466;
+    const float r = 1.f/(float)samstep;
+    for(int i = 0; i < 466; i++)
+    {
+        // the last segment holds its point
+        const float x0 = e[i];
+        const float x1 = i < 465 ? e[i+1] : e[i];
+        struct sramp* p = &env_ramp[i];
+        if(synth[selected_bank].env_interp == 1 && i > 0 && i < 463)
+        {
+            const float c = (x1 - e[i-1]) * 0.5f;
+            const float v = x0 - x1;
+            const float w = c + v;
+            const float a = w + v + (e[i+2] - x0) * 0.5f;
+            const float b_neg = w + a;
+            p->c0 = x0;
+            p->c1 = c * r;
+            p->c2 = -b_neg * r * r;
+            p->c3 = a * r * r * r;
+        }
+        else
+        {
+            p->c0 = x0;
+            p->c1 = (x1 - x0) * r;
+            p->c2 = 0.f;
+            p->c3 = 0.f;
+        }
+    }
+}
+
+void envelopeRamp(float* out, Uint32 n)
+{
+    // a segment lasts samstep+1 filtered samples
+    Uint32 j = 0;
+    while(j < n)
+    {
+        const struct sramp p = env_ramp[envelope_offset];
+        Uint32 run = samstep + 1 - eic;
+        if(run > n - j)
+            run = n - j;
+        for(Uint32 u = 0; u < run; u++)
+        {
+            const float x = (float)(eic + u);
+            out[j+u] = ((p.c3 * x + p.c2) * x + p.c1) * x + p.c0;
+        }
+        j += run;
+
+        // increment envelope stepper
+        eic += run;
+        if(eic > samstep)
+        {
+            eic = 0;
+            if(envelope_offset < 465)
+                envelope_offset++;
+        }
+    }
+}
+
+void doFilters(float* f, const float* offset, Uint32 n)
+{
+    // crush, only every crush_len-th sample is filtered and the rest hold it
+    float kept[MODBLOCK], koff[MODBLOCK], env[MODBLOCK];
+    Uint8 keep[MODBLOCK];
+    Uint32 k = 0;
+    for(Uint32 j = 0; j < n; j++)
+    {
+        keep[j] = 1;
+        if(crush_len != 0)
+        {
+            crush_index++;
+            if(crush_index >= crush_len)
+                crush_index = 0;
+            else
+                keep[j] = 0;
+        }
+        if(keep[j] == 1)
+        {
+            kept[k] = f[j];
+            koff[k] = offset[j];
+            k++;
+        }
+    }
+
+    // biquads
+    biquadsProcess(&biquads, kept, k);
+
+    // scale by the envelope and apply offsets
+    envelopeRamp(env, k);
+    for(Uint32 j = 0; j < k; j++)
+        kept[j] = kept[j] * env[j] - koff[j];
+
+    k = 0;
+    for(Uint32 j = 0; j < n; j++)
+    {
+        if(keep[j] == 1)
+        {
+            f[j] = kept[k];
+            k++;
+            if(crush_len != 0)
+                crush_value = f[j];
+        }
+        else
+        {
+            f[j] = crush_value;
+        }
+    }
+}
+
+/*
+    convolution reverb
+
+    Impulse responses are loaded from ir-N.wav in the prefPath,
+    normalised to unit energy and kept until another one is selected.
+*/
+_Thread_local struct simpulse impulse;
+_Thread_local struct sconv reverb;
+_Thread_local Sint32 impulse_index = -1;
+
+Uint8 loadImpulse(Uint8 index)
+{
+    if(index == impulse_index)
+        return impulse.parts > 0;
+
+    if(impulse.parts > 0)
+    {
+        convFree(&reverb);
+        impulseFree(&impulse);
+    }
+    impulse_index = index;
+    if(index == 0)
+        return 0;
+
+    char file[256];
+    sprintf(file, "%sir-%d.wav", appdir, index);
+    Uint32 len = 0;
+    float* h = loadWAV(file, SAMPLE_RATE, &len);
+    if(h == NULL)
+    {
+        printf("Impulse response could not be loaded: %s\n", file);
+        return 0;
+    }
+
+    double e = 0.0;
+    for(Uint32 i = 0; i < len; i++)
+        e += h[i]*h[i];
+    const float n = e > 0.0 ? 1.0 / sqrt(e) : 1.f;
+    for(Uint32 i = 0; i < len; i++)
+        h[i] *= n;
+
+    if(impulseInit(&impulse, h, len, CONV_BLOCK) < 0 || convInit(&reverb, &impulse) < 0)
+    {
+        printf("Impulse response could not be loaded: %s\n", file);
+        impulseFree(&impulse);
+        free(h);
+        return 0;
+    }
+    free(h);
+    return 1;
+}
+
+void doReverb(const float* in, Uint32 len, float* out)
+{
+    // in is CONV_BLOCK long, len of it is written out
+    float wet[CONV_BLOCK];
+    convProcess(&reverb, in, wet);
+    const float mix = synth[selected_bank].ir_mix;
+    for(Uint32 i = 0; i < len; i++)
+        out[i] = in[i] + (wet[i] - in[i]) * mix;
+}
+
+/*
+    fixed-point render (build with -DFIXED_POINT)
+
+    Mirrors doOsc and doFilters with the integer primitives in fixed.h.
+    The dials are converted once per MODBLOCK and stepped with integer
+    adds, so the only float op per sample is the store. Hi-res
+    oscillators are limited to MAXRESOLUTION and there is no reverb.
+*/
+struct sfxosc
+{
+    Uint8 dial;         // first (frequency) dial
+    Sint8 in1, in2;     // routing index of the inputs, -1 for none
+    Sint8 out1, out2;   // routing index of the outputs, -1 for none
+};
+const struct sfxosc fx_osc[8] = {
+    {16, 9, 8, -1, -1}, {20, 6, 5, 8, -1}, {24, 3, 2, 5, -1}, {28, 0, -1, 2, -1},
+    {0, 7, -1, 9, -1}, {4, 4, -1, 6, 7}, {8, 1, -1, 3, 4}, {12, -1, -1, 0, 1}
+};
+_Thread_local Uint32 fx_phase[8][8];    // oscillator phases, one per unison lane
+_Thread_local Uint32 fx_ratio[8][8];    // Q16 unison lane frequency ratios
+_Thread_local Sint32 fx_gain[8][8];     // Q15 unison lane gains
+_Thread_local Sint32 fx_dial[50];       // dials, Q28 for the biquads and Q15 for the rest
+_Thread_local Sint32 fx_step[50];       // per-sample increments of modulated dials
+_Thread_local Sint32 fx_env[467];       // Q15 envelope, +1 guard point
+_Thread_local Uint8  fx_biquad_on[3];
+_Thread_local struct sfxbiquad fx_biquad[3];
+_Thread_local Sint32 fx_hz = 0;         // Q16 phase increment per Q15 Hz
+_Thread_local Sint32 fx_rsamstep = 0;   // Q16 1/samstep
+_Thread_local Sint32 fx_crush_value = 0;
+
+Sint32 toFixed(Uint32 dial, float v)
+{
+    if(dial >= 32 && dial < 47)
+        return v * 268435456.f;
+    return v * 32768.f;
+}
+
+void updateFixed(Uint32 i)
+{
+    // the float modulation bus only runs at control rate
+    updateModulation(i);
+    for(int j = 0; j < mod_dials; j++)
+    {
+        const Uint32 d = mod_dial[j];
+        fx_dial[d] = toFixed(d, dial_value[d]);
+        fx_step[d] = toFixed(d, mod_step[d]);
+        dial_value[d] += mod_step[d] * MODBLOCK;
+    }
+    for(int k = 0; k < 3; k++)
+    {
+        fx_biquad_on[k] = 0;
+        for(int j = 0; j < 5; j++)
+            if(fZero(dial_value[32+(k*5)+j]) != 1)
+                fx_biquad_on[k] = 1;
+    }
+}
+
+Uint32 fxRouted(Sint32 i)
+{
+    if(i < 0)
+        return 0;
+    return synth[selected_bank].am_state[i] + synth[selected_bank].mul_state[i] + synth[selected_bank].fm_state[i];
+}
+
+void fxInput(Sint32 i, Sint32 input, Sint32* f, Sint32* a, Sint32* r, Sint32* t, Uint8 am)
+{
+    if(i < 0)
+        return;
+
+    if(am == 0)
+    {
+        const Uint8 fm = synth[selected_bank].fm_state[i];
+        if(fm == 1)
+            *f = fxMul(*f, input);
+        else if(fm == 2)
+            *t = fxMul(*t, fxSquish(input));
+        else if(fm == 3)
+            *r = fxMul(*r, fxSquish(input));
+    }
+    else
+    {
+        const Uint8 amm = synth[selected_bank].am_state[i];
+        if(amm == 1)
+            *a = fxMul(*a, input);
+        else if(amm == 2)
+            *r = fxMul(*r, fxSquish(input));
+        else if(amm == 3)
+            *t = fxMul(*t, fxSquish(input));
+    }
+}
+
+Sint32 fxShape(Uint32 shape, Uint32 phase, Sint32 r)
+{
+    if(shape == 0)
+        return fxSin(phase);
+
+    Sint32 (*gen)(Uint32, Sint32) = fxViolin;
+    if(shape == 1)
+        gen = fxSlantSine;
+    else if(shape == 2)
+        gen = fxSquare;
+    else if(shape == 3)
+        gen = fxSawtooth;
+    else if(shape == 4)
+        gen = fxTriangle;
+    else if(shape == 5)
+        gen = fxBipulse;
+
+    const Sint32 rd = r & (FX_ONE-1);
+    if(r < 29*FX_ONE && rd > 0)
+        return ((Sint64)gen(phase, r-rd) * (FX_ONE-rd) + (Sint64)gen(phase, r-rd+FX_ONE) * rd) >> 15;
+    return gen(phase, r);
+}
+
+Sint32 doOscFixed(Uint32 oscid, Sint32 input1, Sint32 input2)
+{
+    const struct sfxosc* p = &fx_osc[oscid];
+
+    // are any outputs enabled?
+    if(p->out1 >= 0 && fxRouted(p->out1) + fxRouted(p->out2) == 0){return 0;}
+
+    Sint32 f = fx_dial[p->dial];
+    Sint32 a = fx_dial[p->dial+1];
+    Sint32 r = fx_dial[p->dial+2];
+    Sint32 t = fx_dial[p->dial+3];
+
+    // fm then am modulation inputs
+    fxInput(p->in1, input1, &f, &a, &r, &t, 0);
+    fxInput(p->in2, input2, &f, &a, &r, &t, 0);
+    fxInput(p->in1, input1, &f, &a, &r, &t, 1);
+    fxInput(p->in2, input2, &f, &a, &r, &t, 1);
+    if(r > MAXRESOLUTION*FX_ONE)
+        r = MAXRESOLUTION*FX_ONE;
+
+    // blending between shapes, summed over the unison lanes
+    Sint32 ts = t * 6;
+    if(ts < 0){ts = 0;}
+    Uint32 shape = ts >> 15;
+    if(shape > 5){shape = 5;}
+    const Sint32 d2 = ts - (shape << 15);
+    const Sint32 d1 = FX_ONE - d2;
+    const Uint32 n = synth[selected_bank].unison_state[oscid] + 1;
+    const Uint32 inc = ((Sint64)f * fx_hz) >> 16;
+    Sint64 o = 0;
+    for(Uint32 j = 0; j < n; j++)
+    {
+        const Uint32 ph = fx_phase[oscid][j];
+        Sint64 v = (Sint64)fxShape(shape, ph, r) * d1;
+        if(d2 > 0)
+            v += (Sint64)fxShape(shape+1, ph, r) * d2;
+        o += n == 1 ? v : (v >> 15) * fx_gain[oscid][j];
+        fx_phase[oscid][j] += n == 1 ? inc : (Uint32)(((Sint64)(Sint32)inc * fx_ratio[oscid][j]) >> 16);
+    }
+    Sint32 out = fxMul(fxSat(o >> 15), a);
+
+    // add/sub/mul modulation inputs
+    const Sint32 in[2] = {p->in1, p->in2};
+    const Sint32 iv[2] = {input1, input2};
+    for(int k = 0; k < 2; k++)
+    {
+        if(in[k] < 0)
+            continue;
+        const Uint8 mod = synth[selected_bank].mul_state[in[k]];
+        if(mod == 1)
+            out = fxSat((Sint64)out + iv[k]);
+        else if(mod == 2)
+            out = fxSat((Sint64)out - iv[k]);
+        else if(mod == 3)
+            out = fxMul(out, iv[k]);
+    }
+
+    return out;
+}
+
+Sint32 doFiltersFixed(Sint32 f)
+{
+    // crush
+    if(crush_len != 0)
+    {
+        crush_index++;
+        if(crush_index >= crush_len)
+            crush_index = 0;
+        else
+            return fx_crush_value;
+    }
+
+    // biquads
+    for(int k = 0; k < 3; k++)
+        if(fx_biquad_on[k] == 1)
+            f = fxBiquad(&fx_biquad[k], &fx_dial[32+(k*5)], f);
+
+    // scale by lerped envelope
+    const Sint32 e0 = fx_env[envelope_offset];
+    const Sint32 e1 = fx_env[envelope_offset+1];
+    f = fxMul(f, e0 + (((Sint64)(e1 - e0) * eic * fx_rsamstep) >> 16));
+
+    // apply offsets
+    f = fxSat((Sint64)f - fx_dial[48]);
+
+    // crush
+    if(crush_len != 0)
+        fx_crush_value = f;
+
+    // increment envelope stepper
+    eic++;
+    if(eic > samstep)
+    {
+        eic = 0;
+        if(envelope_offset < 465)
+            envelope_offset++;
+    }
+
+    return f;
+}
+
+void resetSynth(Uint32 len)
+{
+    eic = 0;
+    crush_index = 0;
+    crush_value = 0.f;
+    for(int i = 0; i < 50; i++)
+        dial_value[i] = synth[selected_bank].dial_state[i] * dialScale(i);
+    for(int i = 0; i < 32; i += 4)
+        dial_value[i] *= transpose; // frequency dials
+    resetModulation();
+    crush_len = dial_value[49] * 33;
+    envelope_offset = dial_value[47] * 466;
+    for(int i = 0; i < 8; i++)
+        oscphase[i] = 0.f;
+    resetUnison();
+    resetHires();
+    render_len = len;
+    buildEnvelope();
+}
+
+/*
+    A render is started once for its whole length and then run in
+    consecutive chunks, out[0] being sample pos of the render. Every
+    chunk but the last must be a multiple of CONV_BLOCK so the reverb
+    blocks line up with it.
+*/
+void synthFixedStart(Uint32 len)
+{
+    resetSynth(len);
+    memset(fx_biquad, 0x00, sizeof(fx_biquad));
+    fx_crush_value = 0;
+    fx_rsamstep = samstep > 0 ? 65536 / samstep : 0;
+    fx_hz = (Sint32)((131072.0 / (double)SAMPLE_RATE) * 65536.0); // 2^32 per cycle / 2^15
+    for(int i = 0; i < 466; i++)
+        fx_env[i] = synth[selected_bank].envelope[i] * 32768.f;
+    fx_env[466] = fx_env[465];
+    for(int i = 0; i < 8; i++)
+    {
+        for(int j = 0; j < 8; j++)
+        {
+            fx_phase[i][j] = (Uint32)(Sint64)(uniphase[i][j] * 683565275.6f); // 2^32 / 2pi
+            fx_ratio[i][j] = uniratio[i][j] * 65536.f;
+            fx_gain[i][j] = unigain[i][j] * 32768.f;
+        }
+    }
+    for(int i = 0; i < 50; i++)
+        fx_dial[i] = toFixed(i, dial_value[i]);
+}
+
+void synthFixedRun(float* out, Uint32 pos, Uint32 n)
+{
+    for(Uint32 i = pos; i < pos + n; i++)
+    {
+        if(i % MODBLOCK == 0)
+            updateFixed(i);
+        for(int j = 0; j < mod_dials; j++)
+            fx_dial[mod_dial[j]] += fx_step[mod_dial[j]];
+
+        const Sint32 o8 = doOscFixed(7, 0, 0);
+        const Sint32 o7 = doOscFixed(6, o8, 0);
+        const Sint32 o4 = doOscFixed(3, o8, 0);
+        const Sint32 o3 = doOscFixed(2, o7, o4);
+        const Sint32 o6 = doOscFixed(5, o7, 0);
+        const Sint32 o2 = doOscFixed(1, o6, o3);
+        const Sint32 o5 = doOscFixed(4, o6, 0);
+        const Sint32 o1 = doOscFixed(0, o5, o2);
+        out[i-pos] = fxToFloat(doFiltersFixed(o1));
+    }
+}
+
+_Thread_local Uint8 filter_mod = 0;    // biquads are resolved per block only when they are modulated
+_Thread_local Uint8 rev_on = 0;
+_Thread_local float rev_block[CONV_BLOCK];
+_Thread_local Uint32 rev_fill = 0;
+
+void synthFloatStart(Uint32 len)
+{
+    resetSynth(len);
+    flushDenormals();
+
+    filter_mod = 0;
+    for(int j = 0; j < mod_dials; j++)
+        if(mod_dial[j] >= 32 && mod_dial[j] < 47)
+            filter_mod = 1;
+    biquadsReset(&biquads);
+    biquadsSet(&biquads, &dial_value[32]);
+
+    // the reverb runs on whole blocks after the filters
+    rev_on = loadImpulse(synth[selected_bank].ir_state);
+    rev_fill = 0;
+    if(rev_on == 1)
+        convReset(&reverb);
+}
+
+void synthFloatRun(float* out, Uint32 pos, Uint32 n)
+{
+    float block[MODBLOCK], offset[MODBLOCK];
+    for(Uint32 i = 0; i < n; i += MODBLOCK)
+    {
+        const Uint32 bn = n - i < MODBLOCK ? n - i : MODBLOCK;
+        updateModulation(pos + i);
+        if(filter_mod == 1)
+            biquadsSet(&biquads, &dial_value[32]);
+
+        for(Uint32 j = 0; j < bn; j++)
+        {
+            for(int k = 0; k < mod_dials; k++)
+                dial_value[mod_dial[k]] += mod_step[mod_dial[k]];
+
+            const float o8 = doOsc(8, 0.f, 0.f);
+            const float o7 = doOsc(7, o8, 0.f);
+            const float o4 = doOsc(4, o8, 0.f);
+            const float o3 = doOsc(3, o7, o4);
+            const float o6 = doOsc(6, o7, 0.f);
+            const float o2 = doOsc(2, o6, o3);
+            const float o5 = doOsc(5, o6, 0.f);
+            block[j] = doOsc(1, o5, o2);
+            offset[j] = dial_value[48];
+        }
+        doFilters(block, offset, bn);
+
+        if(rev_on == 1)
+        {
+            for(Uint32 j = 0; j < bn; j++)
+            {
+                rev_block[rev_fill] = block[j];
+                rev_fill++;
+                if(rev_fill == CONV_BLOCK)
+                {
+                    doReverb(rev_block, CONV_BLOCK, &out[i+j+1-CONV_BLOCK]);
+                    rev_fill = 0;
+                }
+            }
+        }
+        else
+        {
+            memcpy(&out[i], block, bn*sizeof(float));
+        }
+    }
+
+    // last partial reverb block
+    if(rev_on == 1 && rev_fill > 0 && pos + n == render_len)
+    {
+        memset(&rev_block[rev_fill], 0x00, (CONV_BLOCK-rev_fill)*sizeof(float));
+        doReverb(rev_block, rev_fill, &out[n-rev_fill]);
+        rev_fill = 0;
+    }
+}
+
+void synthFixed()
+{
+    setSampleLen(synth[selected_bank].seclen);
+    synthFixedStart(sample_len);
+    synthFixedRun(sample, 0, sample_len);
+}
+
+void synthFloat()
+{
+    setSampleLen(synth[selected_bank].seclen);
+    synthFloatStart(sample_len);
+    synthFloatRun(sample, 0, sample_len);
+}
+
+void synthStart(Uint32 len)
+{
+#ifdef FIXED_POINT
+    synthFixedStart(len);
+#else
+    synthFloatStart(len);
+#endif
+}
+
+void synthRun(float* out, Uint32 pos, Uint32 n)
+{
+#ifdef FIXED_POINT
+    synthFixedRun(out, pos, n);
+#else
+    synthFloatRun(out, pos, n);
+#endif
+}
+
+/*
+    render cache
+
+    The last RENDER_CACHE renders are kept with a hash of the bank
+    struct they came from, going back to a sound already heard, by
+    undo or by playing it again, is then a copy and not a render.
+*/
+#define RENDER_CACHE 4
+
+struct srender
+{
+    Uint64 key;  // renderKey of the bank, 0 = empty
+    Uint32 len;  // samples
+    Uint32 room; // samples buf has room for
+    Uint32 used; // last hit, the oldest is replaced
+    float* buf;
+};
+struct srender render_cache[RENDER_CACHE];
+Uint32 render_uses = 0;
+Uint64 render_key = 0; // of the bank in sample[]
+
+Uint64 renderKey(Uint32 bank)
+{
+    return storeSum((const Uint8*)&synth[bank], sizeof(struct ssynth)) | 1;
+}
+
+Uint8 renderFind(Uint64 key)
+{
+    // copies a cached render into sample[]
+    for(int i = 0; i < RENDER_CACHE; i++)
+    {
+        struct srender* r = &render_cache[i];
+        if(r->key != key)
+            continue;
+        setSampleLen(synth[selected_bank].seclen);
+        if(sample_len != r->len)
+            return 0;
+        memcpy(sample, r->buf, sample_len*sizeof(float));
+        r->used = ++render_uses;
+        return 1;
+    }
+    return 0;
+}
+
+void renderKeep(Uint64 key)
+{
+    // over the slot least recently used, a slot that cannot grow is left empty
+    struct srender* r = &render_cache[0];
+    for(int i = 1; i < RENDER_CACHE; i++)
+        if(render_cache[i].used < r->used)
+            r = &render_cache[i];
+    r->key = 0;
+    r->used = 0;
+    if(sample == NULL || sample_len == 0)
+        return;
+    if(r->room < sample_len)
+    {
+        float* p = realloc(r->buf, sample_len*sizeof(float));
+        if(p == NULL)
+            return;
+        r->buf = p;
+        r->room = sample_len;
+    }
+    memcpy(r->buf, sample, sample_len*sizeof(float));
+    r->len = sample_len;
+    r->key = key;
+    r->used = ++render_uses;
+}
+
+void doSynth(Uint8 play)
+{
+    render_key = renderKey(selected_bank);
+    if(renderFind(render_key) == 0)
+    {
+#ifdef FIXED_POINT
+        synthFixed();
+#else
+        synthFloat();
+#endif
+        renderKeep(render_key);
+    }
+    if(play == 1)
+        playSample();
+}
+
+/*
+    edit history
+
+    An edit is kept as the byte spans of the bank struct it changed,
+    with what they held before and after. They are found by holding
+    the selected bank against a shadow copy once the gesture that
+    made them is over, so a drag of a dial or the envelope is one
+    edit, and scrolling the same value again within HISTORY_MERGE
+    ms is folded into the edit before.
+
+    The edits sit in a ring with a cursor, undo steps it back and
+    redo forward, each one a copy of a few bytes. The oldest are
+    dropped past HISTORY_EDITS edits or HISTORY_BYTES of them.
+*/
+#define HISTORY_EDITS 1024
+#define HISTORY_BYTES 1048576
+#define HISTORY_MERGE 1000 // ms
+#define HISTORY_GAP   2    // equal words that still join two spans
+
+struct sedit
+{
+    Uint32 bank;
+    Uint32 time;  // SDL_GetTicks of the last change
+    Uint32 size;  // bytes of data
+    Uint8 data[]; // spans of Uint16 offset, Uint16 length, old bytes, new bytes
+};
+
+struct shistory
+{
+    struct sedit* edit[HISTORY_EDITS];
+    Uint32 first, count;
+    Uint32 cursor;        // edits applied, the ones above it are redone
+    Uint32 bytes;
+    Uint32 bank;          // of the shadow
+    struct ssynth shadow; // the bank as the last edit left it
+};
+struct shistory history;
+
+Uint32 historySpans(const Uint8* was, const Uint8* now, Uint8* out)
+{
+    // bytes of the spans that differ, in whole 4-byte words so a value always gives the same span
+    const Uint32 n = sizeof(struct ssynth);
+    Uint32 size = 0;
+    Uint32 i = 0;
+    while(i < n)
+    {
+        if(memcmp(&was[i], &now[i], 4) == 0)
+        {
+            i += 4;
+            continue;
+        }
+        Uint32 e = i + 4;
+        for(Uint32 k = e, same = 0; k < n && same < HISTORY_GAP; k += 4)
+        {
+            if(memcmp(&was[k], &now[k], 4) == 0)
+                same++;
+            else
+                same = 0, e = k + 4;
+        }
+        const Uint16 off = i, len = e - i;
+        if(out != NULL)
+        {
+            memcpy(&out[size], &off, 2);
+            memcpy(&out[size+2], &len, 2);
+            memcpy(&out[size+4], &was[i], len);
+            memcpy(&out[size+4+len], &now[i], len);
+        }
+        size += 4 + 2*len;
+        i = e;
+    }
+    return size;
+}
+
+Uint8 historySame(const struct sedit* e, const Uint8* spans, Uint32 size)
+{
+    // the same offsets and lengths
+    if(e->size != size)
+        return 0;
+    for(Uint32 i = 0; i < size;)
+    {
+        Uint16 len;
+        memcpy(&len, &spans[i+2], 2);
+        if(memcmp(&e->data[i], &spans[i], 4) != 0)
+            return 0;
+        i += 4 + 2*len;
+    }
+    return 1;
+}
+
+void historySync()
+{
+    memcpy(&history.shadow, &synth[selected_bank], sizeof(struct ssynth));
+    history.bank = selected_bank;
+    edit_pending = 0;
+}
+
+void historyDrop()
+{
+    // the oldest edit
+    struct sedit* e = history.edit[history.first];
+    history.bytes -= sizeof(struct sedit) + e->size;
+    free(e);
+    history.first = (history.first + 1) % HISTORY_EDITS;
+    history.count--;
+    history.cursor--;
+}
+
+void historyClear()
+{
+    while(history.count > 0)
+    {
+        history.cursor = history.count;
+        historyDrop();
+    }
+    history.first = 0;
+    history.cursor = 0;
+    historySync();
+}
+
+void historyCommit()
+{
+    // the changes since the shadow become an edit, then the shadow follows the selected bank
+    if(edit_pending == 0)
+    {
+        if(history.bank != selected_bank)
+            historySync();
+        return;
+    }
+    const Uint8* was = (const Uint8*)&history.shadow;
+    const Uint8* now = (const Uint8*)&synth[history.bank];
+    const Uint32 size = historySpans(was, now, NULL);
+    if(size == 0)
+    {
+        historySync();
+        return;
+    }
+
+    // scrolling the same value again only moves the new bytes of the last edit
+    const Uint32 t = SDL_GetTicks();
+    if(history.cursor == history.count && history.count > 0)
+    {
+        struct sedit* e = history.edit[(history.first + history.count - 1) % HISTORY_EDITS];
+        Uint8* spans = e->bank == history.bank && t - e->time < HISTORY_MERGE ? malloc(size) : NULL;
+        if(spans != NULL)
+        {
+            historySpans(was, now, spans);
+            if(historySame(e, spans, size) == 1)
+            {
+                for(Uint32 i = 0; i < size;)
+                {
+                    Uint16 len;
+                    memcpy(&len, &spans[i+2], 2);
+                    memcpy(&e->data[i+4+len], &spans[i+4+len], len);
+                    i += 4 + 2*len;
+                }
+                e->time = t;
+                free(spans);
+                historySync();
+                return;
+            }
+        }
+        free(spans);
+    }
+
+    struct sedit* e = malloc(sizeof(struct sedit) + size);
+    if(e == NULL)
+    {
+        historySync();
+        return;
+    }
+    e->bank = history.bank;
+    e->time = t;
+    e->size = size;
+    historySpans(was, now, e->data);
+
+    // a new edit ends the redo, then the oldest go until it fits
+    while(history.count > history.cursor)
+    {
+        history.count--;
+        struct sedit* r = history.edit[(history.first + history.count) % HISTORY_EDITS];
+        history.bytes -= sizeof(struct sedit) + r->size;
+        free(r);
+    }
+    while(history.count > 0 && (history.count == HISTORY_EDITS || history.bytes + sizeof(struct sedit) + size > HISTORY_BYTES))
+        historyDrop();
+    history.edit[(history.first + history.count) % HISTORY_EDITS] = e;
+    history.count++;
+    history.cursor = history.count;
+    history.bytes += sizeof(struct sedit) + size;
+    historySync();
+}
+
+void historyApply(const struct sedit* e, Uint8 redo)
+{
+    // selects the bank of the edit and puts back its old or new bytes
+    selected_bank = e->bank;
+    bankLoad(e->bank);
+    Uint8* p = (Uint8*)&synth[e->bank];
+    for(Uint32 i = 0; i < e->size;)
+    {
+        Uint16 off, len;
+        memcpy(&off, &e->data[i], 2);
+        memcpy(&len, &e->data[i+2], 2);
+        memcpy(&p[off], &e->data[i + 4 + (redo == 1 ? len : 0)], len);
+        i += 4 + 2*len;
+    }
+    markDirty(e->bank);
+    historySync();
+}
+
+Uint8 historyUndo()
+{
+    historyCommit();
+    if(history.cursor == 0)
+        return 0;
+    history.cursor--;
+    historyApply(history.edit[(history.first + history.cursor) % HISTORY_EDITS], 0);
+    return 1;
+}
+
+Uint8 historyRedo()
+{
+    historyCommit();
+    if(history.cursor == history.count)
+        return 0;
+    historyApply(history.edit[(history.first + history.cursor) % HISTORY_EDITS], 1);
+    history.cursor++;
+    return 1;
+}
+
+/*
+    streaming render
+
+    Renders lengths beyond MAXSAMPLELEN straight to a WAV file. The
+    render thread fills a ring of STREAM_RING buffers and the writer
+    thread converts and writes them, so memory stays the same for
+    any length and the envelope is stretched over all of it.
+*/
+#define STREAM_BLOCK 32768 // samples per ring buffer, a multiple of CONV_BLOCK
+#define STREAM_RING  4
+
+struct sstream
+{
+    float* buf[STREAM_RING];
+    Uint32 len[STREAM_RING];
+    SDL_sem* full;
+    SDL_sem* empty;
+    struct ssound out;
+    Uint32 blocks;
+};
+
+int streamWriter(void* data)
+{
+    // keeps draining the ring after a write error so the render never blocks
+    struct sstream* s = data;
+    for(Uint32 k = 0; k < s->blocks; k++)
+    {
+        SDL_SemWait(s->full);
+        soundWrite(&s->out, s->buf[k % STREAM_RING], s->len[k % STREAM_RING]);
+        SDL_SemPost(s->empty);
+    }
+    return 0;
+}
+
+int streamRender(const char* file, Uint32 seconds, Uint32 format)
+{
+    const Uint64 len64 = (Uint64)SAMPLE_RATE * seconds;
+    const Uint64 out64 = export_rate != 0 ? (Uint64)export_rate * seconds : len64; // samples in the file
+    if(len64 == 0 || len64 > 0xFFFFFFFF || (format != SAMPLE_FLAC && out64 * sampleBytes(format) + 44 > 0xFFFFFFFF))
+    {
+        printf("Stream length must be between 1 second and the 4 GB WAV limit.\n");
+        return -1;
+    }
+    const Uint32 len = len64;
+
+    // the ring and the file buffers are the only allocations
+    struct sstream s;
+    memset(&s, 0x00, sizeof(struct sstream));
+    SDL_LockAudio();
+    sample = NULL;
+    sample_len = 0;
+    SDL_UnlockAudio();
+    if(arenaReset(&render_arena, STREAM_RING*STREAM_BLOCK*sizeof(float) + SOUND_BUFFER) < 0)
+        return -1;
+    for(int i = 0; i < STREAM_RING; i++)
+        s.buf[i] = arenaAlloc(&render_arena, STREAM_BLOCK*sizeof(float));
+    s.blocks = (len + STREAM_BLOCK - 1) / STREAM_BLOCK;
+    if(soundOpen(&s.out, &render_arena, file, format, export_rate, export_quality) < 0)
+    {
+        printf("Stream could not be started: %s\n", file);
+        return -1;
+    }
+    s.full = SDL_CreateSemaphore(0);
+    s.empty = SDL_CreateSemaphore(STREAM_RING);
+
+    SDL_Thread* writer = s.full != NULL && s.empty != NULL ? SDL_CreateThread(streamWriter, "borg_stream", &s) : NULL;
+    if(writer == NULL)
+    {
+        printf("Stream writer could not be started: %s\n", SDL_GetError());
+        soundClose(&s.out);
+        SDL_DestroySemaphore(s.full);
+        SDL_DestroySemaphore(s.empty);
+        return -1;
+    }
+
+    const double freq = SDL_GetPerformanceFrequency();
+    const Uint64 t0 = SDL_GetPerformanceCounter();
+    synthStart(len);
+    for(Uint32 k = 0; k < s.blocks; k++)
+    {
+        const Uint32 pos = k * STREAM_BLOCK;
+        const Uint32 n = len - pos < STREAM_BLOCK ? len - pos : STREAM_BLOCK;
+        SDL_SemWait(s.empty);
+        synthRun(s.buf[k % STREAM_RING], pos, n);
+        s.len[k % STREAM_RING] = n;
+        SDL_SemPost(s.full);
+        if(k % 64 == 0)
+        {
+            printf("\r%u / %u seconds", pos / SAMPLE_RATE, seconds);
+            fflush(stdout);
+        }
+    }
+
+    SDL_WaitThread(writer, NULL);
+    const int r = soundClose(&s.out);
+    SDL_DestroySemaphore(s.full);
+    SDL_DestroySemaphore(s.empty);
+
+    const double t = (double)(SDL_GetPerformanceCounter()-t0) / freq;
+    if(r < 0)
+        printf("\rStream could not be written: %s\n", file);
+    else
+        printf("\rStreamed %u seconds to %s in %.1f seconds (%.1fx realtime).\n", seconds, file, t, t > 0.0 ? (double)seconds / t : 0.0);
+    if(r > 0 && format == SAMPLE_FLAC)
+        printf("FLAC is %.1f%% of the 16-bit PCM.\n", 100.0 * soundBytes(&s.out) / (44.0 + out64 * 2.0));
+    if(r > 0 && s.out.resample == 1)
+        printf("Resampled to %u Hz (%s) at %.0fx realtime.\n", export_rate, resample_names[export_quality], seconds / ((double)s.out.rs.ticks / freq));
+    return r;
+}
+
+/*
+    parameter sweep
+
+    A sweep is a text file of axes over the dials and routing of
+    one bank, one per line, # starts a comment:
+
+        bank 1              base patch, numbered from 0 as on screen
+        seconds 1           render length, the bank's by default
+        dial 18 0 30 31     dial, from, to, values on the grid
+        dial 19 0 1 random  drawn for each patch instead
+        am 3 0 3            am, mul or fm button, from, to state
+        fm * 0 3 random     * is every button of its row
+        random 8 1234       patches drawn per grid point, seed
+
+    Dials are in the units they show, so resolution runs 0-30.
+    The grid is every combination of the stepped axes and each
+    point gets the random draws, patch i is worked out from i and
+    the seed alone so the workers can take them in any order. The
+    patches are rendered on the export pool, each worker builds
+    its patch in a scratch bank past the end of the library.
+*/
+#define SWEEP_AXES 64
+#define SWEEP_MAX  1000000 // patches
+#define SWEEP_DIAL 0
+#define SWEEP_AM   1
+#define SWEEP_MUL  2
+#define SWEEP_FM   3
+
+const char* sweep_names[] = {"dial", "am", "mul", "fm"};
+
+struct saxis
+{
+    Uint8 kind;
+    Uint8 index;
+    Uint8 random;   // drawn per patch, not stepped
+    float from, to;
+    Uint32 steps;   // grid values, 1 for random axes
+    float scale;    // of the dial on the base patch
+};
+
+struct ssweep
+{
+    Uint32 bank;
+    Uint32 seconds;     // 0 keeps the bank's
+    Uint32 count;       // random draws per grid point
+    Uint64 seed;
+    Uint32 patches;
+    Uint32 axes;
+    struct saxis axis[SWEEP_AXES];
+    char dir[256];
+    FILE* csv;          // the manifest, one row per file written
+};
+
+Uint64 sweepRandom(Uint64* x)
+{
+    // splitmix64
+    Uint64 z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+int sweepLoad(struct ssweep* w, const char* file)
+{
+    memset(w, 0x00, sizeof(struct ssweep));
+    w->count = 1;
+    FILE* f = fopen(file, "r");
+    if(f == NULL)
+    {
+        printf("%s could not be read.\n", file);
+        return -1;
+    }
+    char line[256];
+    int n = 0;
+    while(fgets(line, sizeof(line), f) != NULL)
+    {
+        n++;
+        char* c = strchr(line, '#');
+        if(c != NULL)
+            *c = 0x00;
+        char key[16], idx[16], last[16] = "";
+        float from = 0.f, to = 0.f;
+        unsigned int a = 0, b = 0;
+        const int k = sscanf(line, "%15s %15s %f %f %15s", key, idx, &from, &to, last);
+        if(k <= 0)
+            continue;
+
+        int kind = -1;
+        for(int i = 0; i < 4; i++)
+            if(strcmp(key, sweep_names[i]) == 0)
+                kind = i;
+        int ok = 0;
+        if(strcmp(key, "bank") == 0)
+            ok = sscanf(line, "%*s %u", &a) == 1 && a < store.count, w->bank = a;
+        else if(strcmp(key, "seconds") == 0)
+            ok = sscanf(line, "%*s %u", &a) == 1 && a >= 1 && a <= MAXSAMPLELEN, w->seconds = a;
+        else if(strcmp(key, "random") == 0)
+            ok = sscanf(line, "%*s %u %u", &a, &b) >= 1 && a >= 1, w->count = a, w->seed = b;
+        else if(kind >= 0 && k >= 4)
+        {
+            // every button of the row for *
+            const Uint32 rows = kind == SWEEP_DIAL ? 50 : 10;
+            Uint32 i0 = atoi(idx), i1 = i0 + 1;
+            if(strcmp(idx, "*") == 0 && kind != SWEEP_DIAL)
+                i0 = 0, i1 = rows;
+            const Uint8 rnd = strcmp(last, "random") == 0;
+            Uint32 steps = kind == SWEEP_DIAL ? (k == 5 && rnd == 0 ? (Uint32)atoi(last) : 1) : (Uint32)(to - from) + 1;
+            if(rnd == 1)
+                steps = 1;
+            ok = i1 <= rows && w->axes + (i1 - i0) <= SWEEP_AXES && steps >= 1 && (kind == SWEEP_DIAL || (from >= 0.f && to <= 3.f && from <= to));
+            for(Uint32 i = i0; i < i1 && ok == 1; i++)
+                w->axis[w->axes++] = (struct saxis){kind, i, rnd, from, to, steps, 1.f};
+        }
+        if(ok == 0)
+        {
+            printf("%s line %d is not a sweep axis: %s", file, n, line);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
 
-        if(r < 29.f && rd > 0.f)
+    Uint64 patches = w->count;
+    for(Uint32 i = 0; i < w->axes; i++)
+        patches *= w->axis[i].steps;
+    if(patches > SWEEP_MAX)
+    {
+        printf("%s expands to %llu patches, at most %d.\n", file, (unsigned long long)patches, SWEEP_MAX);
+        return -1;
+    }
+    w->patches = patches;
+
+    // dials are given in the units of the base patch
+    bankLoad(w->bank);
+    const Uint32 sb = selected_bank;
+    selected_bank = w->bank;
+    for(Uint32 i = 0; i < w->axes; i++)
+        if(w->axis[i].kind == SWEEP_DIAL)
+            w->axis[i].scale = dialScale(w->axis[i].index);
+    selected_bank = sb;
+    return 1;
+}
+
+void sweepPatch(const struct ssweep* w, Uint32 patch, struct ssynth* s, float* value)
+{
+    // the base patch with the axes at their values for this patch, value[] gets them when not NULL
+    *s = synth[w->bank];
+    if(w->seconds != 0)
+        s->seclen = w->seconds;
+    Uint64 x = w->seed ^ ((Uint64)patch << 32);
+    Uint32 g = patch / w->count;
+    for(Uint32 i = 0; i < w->axes; i++)
+    {
+        const struct saxis* a = &w->axis[i];
+        float v = a->from;
+        if(a->random == 1)
         {
-            tr =  getSlantSine(oscphase[oscid], rb) * (1.f-rd);
-            tr += getSlantSine(oscphase[oscid], rb+1.f) * rd;
+            const float u = (float)(sweepRandom(&x) >> 40) / 16777216.f;
+            v = a->kind == SWEEP_DIAL ? a->from + (a->to - a->from) * u : a->from + floorf((a->to - a->from + 1.f) * u);
         }
-        else
+        else if(a->steps > 1)
         {
-            tr = getSlantSine(oscphase[oscid], r);
+            v = a->kind == SWEEP_DIAL ? a->from + (a->to - a->from) * (float)(g % a->steps) / (float)(a->steps - 1) : a->from + (float)(g % a->steps);
+            g /= a->steps;
         }
-        o = (tr * a) * d1;
 
-        if(t > 0.1666666716f)
+        if(a->kind == SWEEP_DIAL)
         {
-            if(r < 29.f && rd > 0.f)
-            {
-                tr =  getSquare(oscphase[oscid], rb) * (1.f-rd);
-                tr += getSquare(oscphase[oscid], rb+1.f) * rd;
-            }
-            else
-            {
-                tr = getSquare(oscphase[oscid], r);
-            }
-            o += (tr * a) * d2;
+            float d = v / a->scale;
+            if(d > 1.f){d = 1.f;}
+            else if(d < (dial_neg[a->index] == 1 ? -1.f : 0.f)){d = dial_neg[a->index] == 1 ? -1.f : 0.f;}
+            s->dial_state[a->index] = d;
+            v = d * a->scale;
         }
+        else if(a->kind == SWEEP_AM)
+            s->am_state[a->index] = v;
+        else if(a->kind == SWEEP_MUL)
+            s->mul_state[a->index] = v;
+        else
+            s->fm_state[a->index] = v;
+        if(value != NULL)
+            value[i] = v;
     }
-    else if(t <= 0.50f)
+}
+
+int sweepPath(char* file, const struct ssweep* w, Uint32 patch, Uint32 format)
+{
+    return snprintf(file, 256, "%spatch-%06u.%s", w->dir, patch, format == SAMPLE_FLAC ? "flac" : "wav") < 256 ? 1 : -1;
+}
+
+int sweepManifest(struct ssweep* w)
+{
+    char file[272];
+    snprintf(file, sizeof(file), "%smanifest.csv", w->dir);
+    w->csv = fopen(file, "w");
+    if(w->csv == NULL)
+        return -1;
+    fprintf(w->csv, "patch,file");
+    for(Uint32 i = 0; i < w->axes; i++)
+        fprintf(w->csv, ",%s%u", sweep_names[w->axis[i].kind], w->axis[i].index);
+    fprintf(w->csv, "\n");
+    return 1;
+}
+
+void sweepRow(const struct ssweep* w, Uint32 patch, const char* file)
+{
+    struct ssynth s;
+    float value[SWEEP_AXES];
+    sweepPatch(w, patch, &s, value);
+    fprintf(w->csv, "%u,%s", patch, file + strlen(w->dir));
+    for(Uint32 i = 0; i < w->axes; i++)
+        fprintf(w->csv, ",%g", value[i]);
+    fprintf(w->csv, "\n");
+}
+
+/*
+    export all banks
+
+    Every used bank is rendered on a pool of worker threads, one
+    per core, each into its own arena. Finished renders are queued
+    to a writer thread so the disk writes overlap the renders, and
+    a worker only waits for its own buffer to be written before it
+    takes the next bank. Progress is read from the written counter.
+
+    A multisample export runs the same pool over the notes of one
+    bank, each transposed from the root key, and the writer adds
+    the loop points and the SFZ that maps the notes to keys. A
+    sweep runs it over the patches of a parameter sweep, and the
+    writer adds a row of the manifest for each.
+*/
+#define EXPORT_WORKERS 16
+#define MULTI_ROOT  60 // key of the bank as it is dialled, middle C
+#define MULTI_LOW   36 // default key range for the K key
+#define MULTI_HIGH  84
+#define MULTI_STEP  3
+#define MULTI_RANGE 48 // semitones either side of the root, keeps fixed point frequencies in range
+
+struct sexportjob
+{
+    Uint32 index;   // entry of bank
+    Uint32 bank;
+    float* buf;     // NULL when the render could not be allocated
+    Uint32 len;
+    SDL_sem* done;  // posted once buf is written and free again
+};
+
+struct sexport
+{
+    Uint32* bank;               // banks to export
+    Uint32 banks;
+    Uint32 format;
+    Uint32 rate, quality;       // of the files, rate 0 is the render rate
+    Uint8 multi;                // bank[] is one bank and note[] its keys
+    struct ssweep* sweep;       // bank[] is its base patch and banks its patches
+    SDL_atomic_t slots;         // scratch banks of a sweep taken by the workers
+    Uint8 root;
+    Uint8 note[256];
+    Uint8 looped[256];          // loop[] found, set by the writer
+    Uint32 loop[256][2];
+    SDL_atomic_t next;          // next entry of bank to render
+    SDL_atomic_t written;       // banks written or failed
+    SDL_atomic_t failed;
+    Uint64 samples, bytes, encode, pcm, resample; // written by the writer, for the report
+    struct sexportjob queue[EXPORT_WORKERS]; // at most one job per worker
+    Uint32 qhead, qtail;
+    SDL_mutex* lock;
+    SDL_sem* ready;
+    SDL_Thread* worker[EXPORT_WORKERS];
+    Uint32 workers;
+    SDL_Thread* writer;
+    Uint64 t0;
+};
+struct sexport export_task;
+Uint8 exporting = 0;
+
+#define EXPORT_TICK  33   // ms between redraws while exporting, caps them at 30 fps
+#define EXPORT_FLASH 1000 // ms of the hue cycle over the export button once done
+Uint32 tick_event = (Uint32)-1;
+SDL_TimerID export_timer = 0;
+
+Uint32 exportTick(Uint32 interval, void* param)
+{
+    // runs on the timer thread, the event loop does the drawing
+    SDL_Event e;
+    memset(&e, 0x00, sizeof(SDL_Event));
+    e.type = tick_event;
+    SDL_PushEvent(&e);
+    return interval;
+}
+
+void exportDir(char* dir)
+{
+#ifdef __linux__
+    snprintf(dir, 256, "%s/EXPORTS", getenv("HOME"));
+    mkdir(dir, 0755);
+    snprintf(dir, 256, "%s/EXPORTS/Borg_ER-3/", getenv("HOME"));
+    mkdir(dir, 0755);
+#else
+    dir[0] = 0x00;
+#endif
+}
+
+int exportPath(char* file, Uint32 bank, Uint32 format)
+{
+    // a path cut short would write some other file
+    char dir[256];
+    exportDir(dir);
+    return snprintf(file, 256, "%sbank-%d.%s", dir, bank, format == SAMPLE_FLAC ? "flac" : "wav") < 256 ? 1 : -1;
+}
+
+int notePath(char* file, const char* dir, Uint32 bank, Uint32 note, Uint32 format)
+{
+    // dir is "" for the path the sfz refers to
+    return snprintf(file, 256, "%sbank-%d-%03d.%s", dir, bank, note, format == SAMPLE_FLAC ? "flac" : "wav") < 256 ? 1 : -1;
+}
+
+int writeSFZ(const struct sexport* e)
+{
+    // each note plays the keys nearest to it, the outer ones to the ends of the keyboard
+    char dir[256], file[256];
+    exportDir(dir);
+    if(snprintf(file, sizeof(file), "%sbank-%d.sfz", dir, e->bank[0]) >= (int)sizeof(file))
+        return -1;
+    FILE* f = fopen(file, "w");
+    if(f == NULL)
+        return -1;
+    fprintf(f, "// Borg ER-3 bank %d, %d notes\n\n", e->bank[0], e->banks);
+    for(Uint32 i = 0; i < e->banks; i++)
     {
-        float d1 = 0.1666666716f - (t - 0.3333333433f);
-        float d2 = 0.1666666716f - d1;
-        d1 *= 6.f;
-        d2 *= 6.f;
+        const Uint32 lo = i == 0 ? 0 : (e->note[i-1] + e->note[i]) / 2 + 1;
+        const Uint32 hi = i == e->banks-1 ? 127 : (e->note[i] + e->note[i+1]) / 2;
+        char sample[256];
+        notePath(sample, "", e->bank[i], e->note[i], e->format);
+        fprintf(f, "<region> sample=%s pitch_keycenter=%d lokey=%d hikey=%d", sample, e->note[i], lo, hi);
+        if(e->looped[i] == 1)
+            fprintf(f, " loop_mode=loop_continuous loop_start=%u loop_end=%u\n", e->loop[i][0], e->loop[i][1]);
+        else
+            fprintf(f, " loop_mode=no_loop\n");
+    }
+    const int r = ferror(f) ? -1 : 1;
+    if(fclose(f) != 0 || r < 0)
+        return -1;
+    printf("SFZ written to: %s\n", file);
+    return 1;
+}
 
-        float tr, rb, rd;
-        modff(r, &rb);
-        rd = r-rb;
+int exportWorker(void* data)
+{
+    struct sexport* e = data;
+    struct sarena a;
+    memset(&a, 0x00, sizeof(struct sarena));
+    SDL_sem* done = SDL_CreateSemaphore(0);
+    const Uint32 slot = store.count + SDL_AtomicAdd(&e->slots, 1);
+    while(1)
+    {
+        const int i = SDL_AtomicAdd(&e->next, 1);
+        if(i >= (int)e->banks)
+            break;
+
+        // rendered from this thread's own copy, the UI goes on editing synth[]
+        libraryLock();
+        if(e->sweep != NULL)
+            sweepPatch(e->sweep, i, &synth[slot], NULL);
+        else
+            synth[slot] = synth[e->bank[i]];
+        libraryUnlock();
+        selected_bank = slot;
+        transpose = e->multi == 1 ? powf(2.f, ((float)e->note[i] - (float)e->root) / 12.f) : 1.f;
+        struct sexportjob j = {i, e->sweep != NULL ? slot : e->bank[i], NULL, sdlaudioformat.freq * synth[slot].seclen, done};
+        if(j.len > MAX_SAMPLE)
+            j.len = MAX_SAMPLE;
+        if(arenaReset(&a, j.len*sizeof(float)) == 1)
+            j.buf = arenaAlloc(&a, j.len*sizeof(float));
+        if(j.buf != NULL)
+        {
+            synthStart(j.len);
+            synthRun(j.buf, 0, j.len);
+        }
 
-        if(r < 29.f && rd > 0.f)
+        SDL_LockMutex(e->lock);
+        e->queue[e->qhead % EXPORT_WORKERS] = j;
+        e->qhead++;
+        SDL_UnlockMutex(e->lock);
+        SDL_SemPost(e->ready);
+        SDL_SemWait(done);
+    }
+    loadImpulse(0); // frees this thread's impulse response
+    transpose = 1.f;
+    arenaFree(&a);
+    SDL_DestroySemaphore(done);
+    return 0;
+}
+
+void exportLoop(struct sexport* e, const struct sexportjob* j, const struct ssound* out)
+{
+    // found on the render, moved to the nearest rising crossings of the resampled file
+    Uint32* l = e->loop[j->index];
+    e->looped[j->index] = findLoop(j->buf, j->len, &l[0], &l[1]);
+    if(e->looped[j->index] == 0 || out->resample == 0)
+        return;
+    l[0] = crossingNear(&out->rs, j->buf, j->len, crossingAt(j->buf, l[0]-1, SAMPLE_RATE, e->rate));
+    l[1] = crossingNear(&out->rs, j->buf, j->len, crossingAt(j->buf, l[1], SAMPLE_RATE, e->rate)) - 1;
+}
+
+int exportWriter(void* data)
+{
+    struct sexport* e = data;
+    struct sarena a;
+    memset(&a, 0x00, sizeof(struct sarena));
+    arenaReset(&a, SOUND_BUFFER);
+    for(Uint32 k = 0; k < e->banks; k++)
+    {
+        SDL_SemWait(e->ready);
+        SDL_LockMutex(e->lock);
+        const struct sexportjob j = e->queue[e->qtail % EXPORT_WORKERS];
+        e->qtail++;
+        SDL_UnlockMutex(e->lock);
+
+        char file[256];
+        int path = 1;
+        if(e->multi == 1)
         {
-            tr =  getSquare(oscphase[oscid], rb) * (1.f-rd);
-            tr += getSquare(oscphase[oscid], rb+1.f) * rd;
+            char dir[256];
+            exportDir(dir);
+            path = notePath(file, dir, j.bank, e->note[j.index], e->format);
+        }
+        else if(e->sweep != NULL)
+        {
+            path = sweepPath(file, e->sweep, j.index, e->format);
         }
         else
         {
-            tr = getSquare(oscphase[oscid], r);
+            path = exportPath(file, j.bank, e->format);
         }
-        o = (tr * a) * d1;
-
-        if(t > 0.3333333433f)
+        struct ssound out;
+        int r = -1;
+        const Uint64 t0 = SDL_GetPerformanceCounter();
+        if(j.buf != NULL && path == 1 && soundOpen(&out, &a, file, e->format, e->rate, e->quality) == 1)
         {
-            if(r < 29.f && rd > 0.f)
-            {
-                tr =  getSawtooth(oscphase[oscid], rb) * (1.f-rd);
-                tr += getSawtooth(oscphase[oscid], rb+1.f) * rd;
-            }
-            else
-            {
-                tr = getSawtooth(oscphase[oscid], r);
-            }
-            o += (tr * a) * d2;
+            r = soundWrite(&out, j.buf, j.len);
+            if(r == 1 && e->multi == 1)
+                exportLoop(e, &j, &out); // before the close, the resampler is still set up
+            if(soundClose(&out) < 0)
+                r = -1;
+            e->encode += SDL_GetPerformanceCounter() - t0;
+            e->samples += j.len;
+            e->bytes += soundBytes(&out);
+            e->pcm += 44 + (out.resample == 1 ? out.rs.out : j.len) * 2;
+            if(out.resample == 1)
+                e->resample += out.rs.ticks;
+        }
+        if(r < 0)
+        {
+            printf("%s %d could not be exported: %s\n", e->sweep != NULL ? "Patch" : "Bank", e->sweep != NULL ? j.index : j.bank, file);
+            SDL_AtomicAdd(&e->failed, 1);
+        }
+        else if(e->sweep != NULL)
+        {
+            sweepRow(e->sweep, j.index, file);
+        }
+        else if(e->multi == 0 && e->banks == 1)
+        {
+            printf("File written to: %s\n", file);
         }
+        SDL_SemPost(j.done);
+        if(e->multi == 1 && k == e->banks-1 && SDL_AtomicGet(&e->failed) == 0 && writeSFZ(e) < 0)
+            printf("SFZ of bank %d could not be written.\n", j.bank);
+        SDL_AtomicAdd(&e->written, 1);
     }
-    else if(t <= 0.6666666865f)
+    arenaFree(&a);
+    return 0;
+}
+
+int exportLaunch(struct sexport* e, Uint32 format)
+{
+    if(e->banks == 0)
     {
-        float d1 = 0.1666666716f - (t - 0.50f);
-        float d2 = 0.1666666716f - d1;
-        d1 *= 6.f;
-        d2 *= 6.f;
+        free(e->bank);
+        return 0;
+    }
+    if(bankRoom(store.count + EXPORT_WORKERS + 1) < 0)
+    {
+        printf("Out of memory for the export.\n");
+        free(e->bank);
+        return -1;
+    }
 
-        float tr, rb, rd;
-        modff(r, &rb);
-        rd = r-rb;
+    // decoded here, the threads copy from synth[]
+    for(Uint32 i = 0; i < (e->sweep != NULL ? 1 : e->banks); i++)
+        bankLoad(e->bank[i]);
+    e->format = format;
+    e->rate = export_rate;
+    e->quality = export_quality;
+    e->workers = SDL_GetCPUCount();
+    if(e->workers > EXPORT_WORKERS)
+        e->workers = EXPORT_WORKERS;
+    if(e->workers > e->banks)
+        e->workers = e->banks;
+    if(e->workers < 1)
+        e->workers = 1;
+    e->lock = SDL_CreateMutex();
+    e->ready = SDL_CreateSemaphore(0);
+    if(e->lock != NULL && e->ready != NULL)
+        e->writer = SDL_CreateThread(exportWriter, "borg_export_io", e);
+    if(e->writer == NULL)
+    {
+        printf("Export could not be started: %s\n", SDL_GetError());
+        SDL_DestroyMutex(e->lock);
+        SDL_DestroySemaphore(e->ready);
+        free(e->bank);
+        return -1;
+    }
+    e->t0 = SDL_GetPerformanceCounter();
 
-        if(r < 29.f && rd > 0.f)
-        {
-            tr =  getSawtooth(oscphase[oscid], rb) * (1.f-rd);
-            tr += getSawtooth(oscphase[oscid], rb+1.f) * rd;
-        }
-        else
+    Uint32 started = 0;
+    for(Uint32 i = 0; i < e->workers; i++)
+    {
+        e->worker[i] = SDL_CreateThread(exportWorker, "borg_export", e);
+        if(e->worker[i] != NULL)
+            started++;
+    }
+    if(started == 0)
+    {
+        // no threads left, render them all here
+        const Uint32 sb = selected_bank;
+        exportWorker(e);
+        selected_bank = sb;
+    }
+    exporting = 1;
+    return e->banks;
+}
+
+int exportStart(const Uint32* bank, Uint32 banks, Uint32 format)
+{
+    struct sexport* e = &export_task;
+    if(exporting == 1)
+        return -1;
+    memset(e, 0x00, sizeof(struct sexport));
+    e->bank = malloc(banks*4 + 4);
+    if(e->bank == NULL)
+        return -1;
+    memcpy(e->bank, bank, banks*4);
+    e->banks = banks;
+    return exportLaunch(e, format);
+}
+
+int multiStart(Uint32 bank, int root, int low, int high, int step, Uint32 format)
+{
+    // every step keys from low to high, within MULTI_RANGE of the root
+    struct sexport* e = &export_task;
+    if(exporting == 1)
+        return -1;
+    if(root < 0 || root > 127 || step < 1)
+        return 0;
+    if(low < root - MULTI_RANGE)
+        low = root - MULTI_RANGE;
+    if(low < 0)
+        low = 0;
+    if(high > root + MULTI_RANGE)
+        high = root + MULTI_RANGE;
+    if(high > 127)
+        high = 127;
+    memset(e, 0x00, sizeof(struct sexport));
+    e->bank = malloc((MULTI_RANGE*2 + 1) * 4);
+    if(e->bank == NULL)
+        return -1;
+    e->multi = 1;
+    e->root = root;
+    for(int n = low; n <= high; n += step)
+    {
+        e->bank[e->banks] = bank;
+        e->note[e->banks] = n;
+        e->banks++;
+    }
+    return exportLaunch(e, format);
+}
+
+int sweepStart(const char* spec, const char* dir, Uint32 format)
+{
+    // the patches of a sweep into dir, with manifest.csv
+    struct sexport* e = &export_task;
+    if(exporting == 1)
+        return -1;
+    memset(e, 0x00, sizeof(struct sexport));
+    struct ssweep* w = malloc(sizeof(struct ssweep));
+    e->bank = malloc(4);
+    if(w == NULL || e->bank == NULL || sweepLoad(w, spec) < 0)
+    {
+        free(w);
+        free(e->bank);
+        return -1;
+    }
+    snprintf(w->dir, sizeof(w->dir), "%s%s", dir, dir[0] != 0x00 && dir[strlen(dir)-1] != '/' ? "/" : "");
+#ifdef __linux__
+    mkdir(w->dir, 0755);
+#endif
+    if(sweepManifest(w) < 0)
+    {
+        printf("Sweep could not be started in %s\n", w->dir);
+        free(w);
+        free(e->bank);
+        return -1;
+    }
+    e->sweep = w;
+    e->bank[0] = w->bank;
+    e->banks = w->patches;
+    const int r = exportLaunch(e, format);
+    if(r <= 0)
+    {
+        fclose(w->csv);
+        free(w);
+        e->sweep = NULL;
+    }
+    return r;
+}
+
+int exportAllStart(Uint32 format)
+{
+    Uint32* bank = malloc(store.count*4);
+    if(bank == NULL)
+        return -1;
+    Uint32 banks = 0;
+    for(Uint32 b = 0; b < store.count; b++)
+        if(bankUsed(b) == 1)
+            bank[banks++] = b;
+    const int r = exportStart(bank, banks, format);
+    free(bank);
+    return r;
+}
+
+Uint8 exportDone()
+{
+    return exporting == 1 && SDL_AtomicGet(&export_task.written) == (int)export_task.banks;
+}
+
+void exportFinish()
+{
+    struct sexport* e = &export_task;
+    if(exporting == 0)
+        return;
+    for(Uint32 i = 0; i < e->workers; i++)
+        if(e->worker[i] != NULL)
+            SDL_WaitThread(e->worker[i], NULL);
+    SDL_WaitThread(e->writer, NULL);
+    SDL_DestroyMutex(e->lock);
+    SDL_DestroySemaphore(e->ready);
+    exporting = 0;
+    free(e->bank);
+    e->bank = NULL;
+
+    const double t = (double)(SDL_GetPerformanceCounter()-e->t0) / (double)SDL_GetPerformanceFrequency();
+    if(e->banks > 1)
+        printf("Exported %d of %d %s on %d threads in %.2f seconds.\n", e->banks - SDL_AtomicGet(&e->failed), e->banks, e->multi == 1 ? "notes" : e->sweep != NULL ? "patches" : "banks", e->workers, t);
+    if(e->sweep != NULL)
+    {
+        printf("%.1f patches a second, manifest written to: %smanifest.csv\n", t > 0.0 ? e->banks / t : 0.0, e->sweep->dir);
+        if(fclose(e->sweep->csv) != 0)
+            printf("The manifest could not be written.\n");
+        free(e->sweep);
+        e->sweep = NULL;
+    }
+    if(e->format == SAMPLE_FLAC && e->samples > 0)
+    {
+        // against the 16-bit wav of the same samples
+        const double enc = (double)e->encode / (double)SDL_GetPerformanceFrequency();
+        printf("FLAC: %.2f MB of 16-bit PCM as %.2f MB (%.1f%%), encoded at %.0fx realtime.\n", e->pcm / 1048576.0, e->bytes / 1048576.0, 100.0 * e->bytes / e->pcm, enc > 0.0 ? e->samples / (enc * SAMPLE_RATE) : 0.0);
+    }
+    if(e->resample > 0)
+    {
+        const double rt = (double)e->resample / (double)SDL_GetPerformanceFrequency();
+        printf("Resampled to %u Hz (%s) at %.0fx realtime, %.1f million samples a second.\n", e->rate, resample_names[e->quality], e->samples / (rt * SAMPLE_RATE), e->samples / rt / 1e6);
+    }
+}
+
+
+/*
+    sound matching
+
+    Evolves the dials and routing of a bank toward a target WAV.
+    A candidate is rendered for the length of the target but only
+    its first MATCH_WINDOW samples are run, and scored by the mean
+    distance of its log magnitude spectra to the target's at three
+    STFT sizes, both normalised to unit RMS so only the sound counts
+    and not its level.
+
+    The search is a (mu + lambda) evolution strategy: each generation
+    MATCH_CHILDREN children of the MATCH_PARENTS best are rendered,
+    the dials with gaussian steps of a size that grows while it
+    finds better patches and shrinks when it stops, the routing
+    buttons flipped now and then. The children are scored on one
+    worker thread per core, each with its own scratch bank, render
+    buffer and FFT scratch for the whole search.
+*/
+#define MATCH_WINDOW   22016 // samples compared, half a second in whole CONV_BLOCKs
+#define MATCH_RES      3
+#define MATCH_PARENTS  8
+#define MATCH_CHILDREN 64
+#define MATCH_POP      (MATCH_PARENTS + MATCH_CHILDREN)
+#define MATCH_STEP     0.15f // first step of the dials
+#define MATCH_FLIP     0.03f // chance of a routing button changing
+#define MATCH_GENERATIONS 100
+#define MATCH_BAD      1e30f // score of a patch that could not be rendered
+
+const Uint32 match_fft[MATCH_RES] = {256, 1024, 4096};
+
+struct smatch
+{
+    Uint32 len;                     // samples compared
+    Uint32 full;                    // samples of the render
+    struct sfft fft[MATCH_RES];
+    float* window[MATCH_RES];       // hann
+    float* target[MATCH_RES];       // log power, frames of n/2+1 bins
+    Uint32 frames[MATCH_RES];
+    struct ssynth pop[MATCH_POP];   // parents first
+    float loss[MATCH_POP];
+    Uint32 first;                   // of the ones to score
+    SDL_atomic_t next;
+    SDL_atomic_t slots;
+    SDL_atomic_t renders;
+    SDL_sem* go;
+    SDL_sem* done;
+    Uint8 quit;
+    SDL_Thread* worker[EXPORT_WORKERS];
+    Uint32 workers;
+};
+
+void matchSpectra(const struct smatch* m, const float* x, float* scratch, float* out[MATCH_RES], float* loss)
+{
+    // log power frames of x into out, or their distance to the target into loss when out is NULL
+    double e = 0.0;
+    for(Uint32 i = 0; i < m->len; i++)
+    {
+        // patches that blow up are scored worst
+        if(blownUp(x[i]) == 1)
         {
-            tr = getSawtooth(oscphase[oscid], r);
+            if(loss != NULL)
+                *loss = MATCH_BAD;
+            return;
         }
-        o = (tr * a) * d1;
-        
-        if(t > 0.50f)
+        e += x[i]*x[i];
+    }
+    const float g = e > 0.0 ? 1.0 / sqrt(e / m->len) : 1.f;
+    double sum = 0.0;
+    for(int r = 0; r < MATCH_RES; r++)
+    {
+        const Uint32 n = match_fft[r], bins = n/2 + 1;
+        const float eps = n * 1e-5f;
+        float* w = scratch;
+        float* re = scratch + n;
+        float* im = re + bins;
+        double d = 0.0;
+        for(Uint32 f = 0; f < m->frames[r]; f++)
         {
-            if(r < 29.f && rd > 0.f)
-            {
-                tr =  getTriangle(oscphase[oscid], rb) * (1.f-rd);
-                tr += getTriangle(oscphase[oscid], rb+1.f) * rd;
-            }
-            else
+            const float* in = &x[f * n/2];
+            for(Uint32 i = 0; i < n; i++)
+                w[i] = in[i] * m->window[r][i] * g;
+            fftReal(&m->fft[r], w, re, im);
+            float* t = &m->target[r][f * bins];
+            for(Uint32 k = 0; k < bins; k++)
             {
-                tr = getTriangle(oscphase[oscid], r);
+                const float l = logf(re[k]*re[k] + im[k]*im[k] + eps);
+                if(out != NULL)
+                    out[r][f * bins + k] = l;
+                else
+                    d += fabsf(l - t[k]);
             }
-            o += (tr * a) * d2;
         }
+        sum += d / ((double)m->frames[r] * bins);
     }
-    else if(t <= 0.8333333731f)
-    {
-        float d1 = 0.1666666716f - (t - 0.6666666865f);
-        float d2 = 0.1666666716f - d1;
-        d1 *= 6.f;
-        d2 *= 6.f;
-
-        float tr, rb, rd;
-        modff(r, &rb);
-        rd = r-rb;
+    if(loss != NULL)
+        *loss = sum;
+}
 
-        if(r < 29.f && rd > 0.f)
+int matchWorker(void* data)
+{
+    struct smatch* m = data;
+    const Uint32 slot = store.count + SDL_AtomicAdd(&m->slots, 1);
+    struct sarena a;
+    memset(&a, 0x00, sizeof(struct sarena));
+    const Uint32 n = match_fft[MATCH_RES-1];
+    float* buf = NULL;
+    float* scratch = NULL;
+    if(arenaReset(&a, (m->len + n*2 + 2) * sizeof(float) + ARENA_ALIGN) == 1)
+    {
+        buf = arenaAlloc(&a, m->len * sizeof(float));
+        scratch = arenaAlloc(&a, (n*2 + 2) * sizeof(float));
+    }
+    while(1)
+    {
+        SDL_SemWait(m->go);
+        if(m->quit == 1)
+            break;
+        while(1)
         {
-            tr =  getTriangle(oscphase[oscid], rb) * (1.f-rd);
-            tr += getTriangle(oscphase[oscid], rb+1.f) * rd;
+            const int i = SDL_AtomicAdd(&m->next, 1);
+            if(i >= MATCH_POP)
+                break;
+            m->loss[i] = MATCH_BAD;
+            if(buf == NULL)
+                continue;
+            synth[slot] = m->pop[i];
+            selected_bank = slot;
+            synthStart(m->full);
+            synthRun(buf, 0, m->len);
+            matchSpectra(m, buf, scratch, NULL, &m->loss[i]);
+            SDL_AtomicAdd(&m->renders, 1);
         }
-        else
+        SDL_SemPost(m->done);
+    }
+    loadImpulse(0);
+    arenaFree(&a);
+    return 0;
+}
+
+void matchScore(struct smatch* m, Uint32 first)
+{
+    // pop[first] on, the workers take them in turn
+    SDL_AtomicSet(&m->next, first);
+    for(Uint32 i = 0; i < m->workers; i++)
+        SDL_SemPost(m->go);
+    for(Uint32 i = 0; i < m->workers; i++)
+        SDL_SemWait(m->done);
+}
+
+float matchGauss(Uint64* x)
+{
+    // box-muller
+    const double u = ((sweepRandom(x) >> 11) + 0.5) / 9007199254740992.0;
+    const double v = (sweepRandom(x) >> 11) / 9007199254740992.0;
+    return sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v);
+}
+
+void matchMutate(struct ssynth* s, float step, Uint64* x)
+{
+    for(int i = 0; i < 50; i++)
+    {
+        float d = s->dial_state[i] + matchGauss(x) * step;
+        const float lo = dial_neg[i] == 1 ? -1.f : 0.f;
+        if(d > 1.f){d = 1.f;}
+        else if(d < lo){d = lo;}
+        s->dial_state[i] = d;
+    }
+    for(int i = 0; i < 10; i++)
+    {
+        Uint8* r[3] = {&s->am_state[i], &s->mul_state[i], &s->fm_state[i]};
+        for(int k = 0; k < 3; k++)
+            if((sweepRandom(x) >> 40) < (Uint64)(MATCH_FLIP * 16777216.f))
+                *r[k] = sweepRandom(x) % 4;
+    }
+}
+
+int matchBank(const char* file, Uint32 bank, Uint32 generations)
+{
+    // writes the best patch found into bank, -1 when the search could not run
+    static struct smatch m;
+    memset(&m, 0x00, sizeof(struct smatch));
+    Uint32 tlen = 0;
+    float* target = loadWAV(file, SAMPLE_RATE, &tlen);
+    if(target == NULL || tlen < match_fft[MATCH_RES-1])
+    {
+        printf("%s could not be loaded or is shorter than %u samples.\n", file, match_fft[MATCH_RES-1]);
+        free(target);
+        return -1;
+    }
+    Uint32 seclen = (tlen + SAMPLE_RATE/2) / SAMPLE_RATE;
+    if(seclen < 1){seclen = 1;}
+    else if(seclen > MAXSAMPLELEN){seclen = MAXSAMPLELEN;}
+    m.full = sdlaudioformat.freq * seclen;
+    if(m.full > MAX_SAMPLE)
+        m.full = MAX_SAMPLE;
+    m.len = tlen < MATCH_WINDOW ? tlen : MATCH_WINDOW;
+    if(m.len > m.full)
+        m.len = m.full;
+    if(m.len < m.full)
+        m.len -= m.len % CONV_BLOCK; // the reverb only flushes a part block at the end of the render
+
+    int r = bankRoom(store.count + EXPORT_WORKERS + 1);
+    float* scratch = malloc((match_fft[MATCH_RES-1]*2 + 2) * sizeof(float));
+    r = r == 1 && scratch != NULL ? 1 : -1;
+    for(int k = 0; k < MATCH_RES && r == 1; k++)
+    {
+        const Uint32 n = match_fft[k];
+        m.frames[k] = (m.len - n) / (n/2) + 1;
+        m.window[k] = malloc(n * sizeof(float));
+        m.target[k] = malloc((size_t)m.frames[k] * (n/2 + 1) * sizeof(float));
+        if(fftInit(&m.fft[k], n) < 0 || m.window[k] == NULL || m.target[k] == NULL)
+            r = -1;
+        for(Uint32 i = 0; i < n && r == 1; i++)
+            m.window[k][i] = 0.5f - 0.5f * cosf(6.283185307f * i / n);
+    }
+    if(r == 1)
+        matchSpectra(&m, target, scratch, m.target, NULL);
+    free(scratch);
+    free(target);
+
+    m.go = SDL_CreateSemaphore(0);
+    m.done = SDL_CreateSemaphore(0);
+    if(m.go == NULL || m.done == NULL)
+        r = -1;
+    if(r == 1)
+    {
+        Uint32 w = SDL_GetCPUCount();
+        if(w > EXPORT_WORKERS)
+            w = EXPORT_WORKERS;
+        for(Uint32 i = 0; i < w; i++)
+            if((m.worker[m.workers] = SDL_CreateThread(matchWorker, "borg_match", &m)) != NULL)
+                m.workers++;
+        if(m.workers == 0)
+            r = -1;
+    }
+
+    if(r == 1)
+    {
+        // the bank as it is, and mutations of it
+        Uint64 x = 0x5EED ^ ((Uint64)bank << 32);
+        bankLoad(bank);
+        m.pop[0] = synth[bank];
+        m.pop[0].seclen = seclen;
+        for(int i = 1; i < MATCH_POP; i++)
         {
-            tr = getTriangle(oscphase[oscid], r);
+            m.pop[i] = m.pop[0];
+            matchMutate(&m.pop[i], MATCH_STEP, &x);
         }
-        o = (tr * a) * d1;
-        
-        if(t > 0.6666666865f)
+        const Uint64 t0 = SDL_GetPerformanceCounter();
+        matchScore(&m, 0);
+        const float start = m.loss[0];
+        float step = MATCH_STEP;
+        for(Uint32 g = 0; g <= generations; g++)
         {
-            if(r < 29.f && rd > 0.f)
+            // the best MATCH_PARENTS to the front
+            const float best = m.loss[0];
+            for(int i = 0; i < MATCH_PARENTS; i++)
             {
-                tr =  getBipulse(oscphase[oscid], rb) * (1.f-rd);
-                tr += getBipulse(oscphase[oscid], rb+1.f) * rd;
+                int b = i;
+                for(int j = i+1; j < MATCH_POP; j++)
+                    if(m.loss[j] < m.loss[b])
+                        b = j;
+                if(b != i)
+                {
+                    const struct ssynth s = m.pop[i];
+                    const float l = m.loss[i];
+                    m.pop[i] = m.pop[b], m.loss[i] = m.loss[b];
+                    m.pop[b] = s, m.loss[b] = l;
+                }
             }
-            else
+            step *= m.loss[0] < best ? 1.1f : 0.85f;
+            if(step > 0.5f){step = 0.5f;}
+            else if(step < 0.002f){step = 0.002f;}
+
+            const double t = (double)(SDL_GetPerformanceCounter()-t0) / (double)SDL_GetPerformanceFrequency();
+            printf("\rgeneration %u / %u  loss %.4f  %.0f renders a second on %u threads ", g, generations, m.loss[0], t > 0.0 ? SDL_AtomicGet(&m.renders) / t : 0.0, m.workers);
+            fflush(stdout);
+            if(g == generations)
+                break;
+
+            for(int i = MATCH_PARENTS; i < MATCH_POP; i++)
             {
-                tr = getBipulse(oscphase[oscid], r);
+                m.pop[i] = m.pop[sweepRandom(&x) % MATCH_PARENTS];
+                matchMutate(&m.pop[i], step, &x);
             }
-            o += (tr * a) * d2;
+            matchScore(&m, MATCH_PARENTS);
         }
+        printf("\n");
+
+        synth[bank] = m.pop[0];
+        markDirty(bank);
+        if(start < MATCH_BAD)
+            printf("Bank %u matched to %s, loss %.4f from %.4f.\n", bank, file, m.loss[0], start);
+        else
+            printf("Bank %u matched to %s, loss %.4f, it blew up as it was.\n", bank, file, m.loss[0]);
     }
     else
     {
-        float d1 = 0.1666666716f - (t - 0.8333333731f);
-        float d2 = 0.1666666716f - d1;
-        d1 *= 6.f;
-        d2 *= 6.f;
+        printf("Matching could not be started.\n");
+    }
 
-        float tr, rb, rd;
-        modff(r, &rb);
-        rd = r-rb;
+    m.quit = 1;
+    for(Uint32 i = 0; i < m.workers; i++)
+        SDL_SemPost(m.go);
+    for(Uint32 i = 0; i < m.workers; i++)
+        SDL_WaitThread(m.worker[i], NULL);
+    if(m.go != NULL)
+        SDL_DestroySemaphore(m.go);
+    if(m.done != NULL)
+        SDL_DestroySemaphore(m.done);
+    for(int k = 0; k < MATCH_RES; k++)
+    {
+        fftFree(&m.fft[k]);
+        free(m.window[k]);
+        free(m.target[k]);
+    }
+    return r;
+}
 
-        if(r < 29.f && rd > 0.f)
-        {
-            tr =  getBipulse(oscphase[oscid], rb) * (1.f-rd);
-            tr += getBipulse(oscphase[oscid], rb+1.f) * rd;
-        }
-        else
-        {
-            tr = getBipulse(oscphase[oscid], r);
-        }
-        o = (tr * a) * d1;
-        
-        if(t > 0.8333333731f)
+/*
+    similar banks
+
+    Each used bank is rendered once for FP_SECONDS, its envelope
+    squeezed into them, and reduced to FP_DIM numbers: the shape of
+    its average spectrum in FP_BANDS log spaced bands, the shape of
+    its loudness over FP_SEGS slices of time, and how bright, how
+    busy and how long it is. Level is taken out of all of them.
+
+    The vectors are kept in <library>.fp with the checksum of the
+    record they came from, a bank whose record no longer has that
+    checksum is rendered again. In the app a thread works through
+    the stale banks in the background and sleeps until a save or
+    a reload kicks it. It copies a bank into a scratch bank past
+    the end of the library under library_lock and renders it with
+    the lock let go, the vector is only kept if the record did not
+    change meanwhile. A query is a brute
+    force scan of the vectors, 8 floats at a time.
+*/
+#define FP_DIM     48
+#define FP_BANDS   32
+#define FP_SEGS    8
+#define FP_FFT     2048
+#define FP_SECONDS 2
+#define FP_K       8    // banks a query returns
+#define FP_SCRATCH (FP_FFT*2 + 2)
+
+struct sfpindex
+{
+    Uint32 room;
+    Uint32* key;        // record checksum of the vector, 0 = none
+    float* vec;         // FP_DIM per bank
+    Uint8 changed;      // since the file was written
+    Uint8 ready;        // fpInit done
+    Uint8 quit;
+    SDL_sem* kick;      // NULL without the thread
+    SDL_Thread* thread;
+    struct sfft fft;
+    float window[FP_FFT];
+    Uint32 edge[FP_BANDS+1]; // first bin of each band
+};
+struct sfpindex fp_index;
+
+void fpKick()
+{
+    if(fp_index.kick != NULL)
+        SDL_SemPost(fp_index.kick);
+}
+
+int fpRoom(Uint32 count)
+{
+    if(count <= fp_index.room)
+        return 1;
+    const Uint32 n = storeCapacity(count);
+    Uint32* key = realloc(fp_index.key, (size_t)n * 4);
+    if(key != NULL)
+        fp_index.key = key;
+    float* vec = realloc(fp_index.vec, (size_t)n * FP_DIM * sizeof(float));
+    if(vec != NULL)
+        fp_index.vec = vec;
+    if(key == NULL || vec == NULL)
+        return -1;
+    memset(fp_index.key + fp_index.room, 0x00, (size_t)(n - fp_index.room) * 4);
+    fp_index.room = n;
+    return 1;
+}
+
+void fpPath(char* file)
+{
+    snprintf(file, 272, "%s.fp", store.path);
+}
+
+int fpInit()
+{
+    // the tables, then the vectors of the last run
+    if(fp_index.ready == 1)
+        return 1;
+    if(fftInit(&fp_index.fft, FP_FFT) < 0 || fpRoom(store.count) < 0)
+        return -1;
+    for(Uint32 i = 0; i < FP_FFT; i++)
+        fp_index.window[i] = 0.5f - 0.5f * cosf(6.283185307f * i / FP_FFT);
+    const float lo = 50.f, hi = 16000.f, bin = (float)SAMPLE_RATE / FP_FFT;
+    for(Uint32 j = 0; j <= FP_BANDS; j++)
+    {
+        Uint32 e = lo * powf(hi / lo, (float)j / FP_BANDS) / bin;
+        if(j > 0 && e <= fp_index.edge[j-1])
+            e = fp_index.edge[j-1] + 1;
+        fp_index.edge[j] = e;
+    }
+    fp_index.ready = 1;
+
+    char file[272];
+    fpPath(file);
+    FILE* f = fopen(file, "rb");
+    if(f == NULL)
+        return 1;
+    char magic[8];
+    Uint32 dim = 0, count = 0;
+    if(fread(magic, 8, 1, f) == 1 && memcmp(magic, "BORGFP01", 8) == 0 && fread(&dim, 4, 1, f) == 1 && fread(&count, 4, 1, f) == 1 &&
+       dim == FP_DIM && fpRoom(count) == 1)
+    {
+        if(fread(fp_index.key, 4, count, f) != count || fread(fp_index.vec, FP_DIM * sizeof(float), count, f) != count)
+            memset(fp_index.key, 0x00, (size_t)fp_index.room * 4);
+    }
+    fclose(f);
+    return 1;
+}
+
+void fpSave()
+{
+    // a cache, a failed write only costs renders
+    if(fp_index.changed == 0 || store.path[0] == 0x00)
+        return;
+    char file[272], tmp[280];
+    fpPath(file);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    FILE* f = fopen(tmp, "wb");
+    if(f == NULL)
+        return;
+    const Uint32 dim = FP_DIM, count = store.count < fp_index.room ? store.count : fp_index.room;
+    int r = fwrite("BORGFP01", 8, 1, f) == 1 && fwrite(&dim, 4, 1, f) == 1 && fwrite(&count, 4, 1, f) == 1 &&
+            fwrite(fp_index.key, 4, count, f) == count && fwrite(fp_index.vec, FP_DIM * sizeof(float), count, f) == count;
+    if(fclose(f) != 0)
+        r = 0;
+#ifndef __linux__
+    if(r == 1)
+        remove(file);
+#endif
+    if(r == 1 && rename(tmp, file) == 0)
+        fp_index.changed = 0;
+    else
+        remove(tmp);
+}
+
+Uint32 fpKey(Uint32 b)
+{
+    // the checksum of a clean used record, 0 for banks that are not indexed
+    if(b >= store.count || store.dirty[b] == 1 || storeIntact(&store) == 0 || (store.index[b] & STORE_USED) == 0)
+        return 0;
+    const Uint8* r = store.base + (size_t)b * BANK_RECORD;
+    return (getU16(&r[BANK_SUM]) | getU16(&r[BANK_SUM+2]) << 16) | 1;
+}
+
+void fpFeatures(const float* x, Uint32 len, Uint32 seclen, float* v, float* scratch)
+{
+    const Uint32 n = FP_FFT, bins = n/2 + 1, hop = n/2;
+    const Uint32 frames = (len - n) / hop + 1;
+    const float eps = n * 1e-6f;
+    float* w = scratch;
+    float* re = w + n;
+    float* im = re + bins;
+    double band[FP_BANDS] = {0.0}, band2[FP_BANDS] = {0.0};
+    double cen = 0.0, cen2 = 0.0, flux = 0.0;
+    float prev[FP_BANDS];
+    for(Uint32 f = 0; f < frames; f++)
+    {
+        for(Uint32 i = 0; i < n; i++)
+            w[i] = x[f*hop + i] * fp_index.window[i];
+        fftReal(&fp_index.fft, w, re, im);
+        double p = 0.0, pk = 0.0;
+        for(Uint32 j = 0; j < FP_BANDS; j++)
         {
-            if(r < 29.f && rd > 0.f)
-            {
-                tr =  getViolin(oscphase[oscid], rb) * (1.f-rd);
-                tr += getViolin(oscphase[oscid], rb+1.f) * rd;
-            }
-            else
+            double e = 0.0;
+            for(Uint32 k = fp_index.edge[j]; k < fp_index.edge[j+1] && k < bins; k++)
             {
-                tr = getViolin(oscphase[oscid], r);
+                const float q = re[k]*re[k] + im[k]*im[k];
+                e += q;
+                pk += q * k;
             }
-            o += (tr * a) * d2;
+            p += e;
+            const float l = logf(e + eps);
+            band[j] += l;
+            band2[j] += l*l;
+            if(f > 0)
+                flux += fabsf(l - prev[j]);
+            prev[j] = l;
         }
+        const float c = log2f(((p > 0.0 ? pk / p : 0.0) * SAMPLE_RATE / n + 1.f) / 1000.f);
+        cen += c;
+        cen2 += c*c;
     }
 
-    // add/sub/mul modulation inputs
-    if(input1_mod != 0)
+    // spectrum shape
+    double mean = 0.0;
+    for(Uint32 j = 0; j < FP_BANDS; j++)
+        mean += band[j] / frames;
+    mean /= FP_BANDS;
+    for(Uint32 j = 0; j < FP_BANDS; j++)
+        v[j] = (band[j] / frames - mean) * 0.5;
+
+    // loudness over time
+    const Uint32 seg = len / FP_SEGS;
+    float l[FP_SEGS];
+    mean = 0.0;
+    for(Uint32 k = 0; k < FP_SEGS; k++)
     {
-        if(input1_mod == 1)
-            o += input1;
-        else if(input1_mod == 2)
-            o -= input1;
-        else if(input1_mod == 3)
-            o *= input1;
+        double e = 0.0;
+        for(Uint32 i = k*seg; i < (k+1)*seg; i++)
+            e += x[i]*x[i];
+        l[k] = 0.5f * logf(e / seg + 1e-6f);
+        mean += l[k] / FP_SEGS;
+    }
+    for(Uint32 k = 0; k < FP_SEGS; k++)
+        v[FP_BANDS + k] = l[k] - mean;
+
+    // brightness, its spread, spectral flux, zero crossings, movement of the low, mid and high bands, length
+    Uint32 zc = 0;
+    for(Uint32 i = 1; i < len; i++)
+        zc += (x[i] >= 0.f) != (x[i-1] >= 0.f);
+    double var[3] = {0.0, 0.0, 0.0};
+    for(Uint32 j = 0; j < FP_BANDS; j++)
+    {
+        const double m = band[j] / frames;
+        const double d = band2[j] / frames - m*m;
+        var[j * 3 / FP_BANDS] += (d > 0.0 ? sqrt(d) : 0.0) / (FP_BANDS / 3);
+    }
+    float* e = &v[FP_BANDS + FP_SEGS];
+    e[0] = cen / frames;
+    const double cv = cen2 / frames - e[0]*e[0];
+    e[1] = cv > 0.0 ? sqrt(cv) : 0.0;
+    e[2] = logf(1.f + flux / (frames * FP_BANDS));
+    e[3] = (float)zc / len * 100.f;
+    e[4] = var[0];
+    e[5] = var[1];
+    e[6] = var[2];
+    e[7] = log2f(seclen > 0 ? seclen : 1);
+}
+
+void fpRender(Uint32 bank, float* buf, float* scratch, float* v)
+{
+    // the bank as selected_bank of this thread
+    const Uint32 sb = selected_bank;
+    const Uint32 len = FP_SECONDS * SAMPLE_RATE;
+    selected_bank = bank;
+    synthStart(len);
+    synthRun(buf, 0, len);
+    for(Uint32 i = 0; i < len; i++)
+        if(blownUp(buf[i]) == 1)
+            buf[i] = 0.f; // reads as silence where a patch blows up
+    fpFeatures(buf, len, synth[bank].seclen, v, scratch);
+    selected_bank = sb;
+}
+
+Uint8 fpNext(Uint32 b, float* buf, float* scratch)
+{
+    // renders bank b when its vector is stale, library_lock is only held for the copy and the result
+    float v[FP_DIM] __attribute__ ((aligned(32)));
+    libraryLock();
+    const Uint32 key = fpKey(b);
+    const Uint32 slot = bank_room - 1; // past the end of the library, bankRoom keeps one spare at least
+    const Uint8 stale = key != 0 && fpRoom(store.count) == 1 && fp_index.key[b] != key &&
+                        bankDecode(store.base + (size_t)b * BANK_RECORD, &synth[slot]) == 1;
+    if(stale == 1 && index_lock != NULL)
+        SDL_LockMutex(index_lock); // before the library is let go, so synth[] cannot move in between
+    libraryUnlock();
+    if(stale == 0)
+        return 0;
+    fpRender(slot, buf, scratch, v);
+    if(index_lock != NULL)
+        SDL_UnlockMutex(index_lock);
+
+    // a save or a reload meanwhile may have changed the record
+    libraryLock();
+    const Uint8 r = fpKey(b) == key && fpRoom(store.count) == 1;
+    if(r == 1)
+    {
+        memcpy(&fp_index.vec[(size_t)b * FP_DIM], v, sizeof(v));
+        fp_index.key[b] = key;
+        fp_index.changed = 1;
     }
+    libraryUnlock();
+    return r;
+}
 
-    if(input2_mod != 0)
+int fpThread(void* unused)
+{
+    // one bank rendered per pass, fpNext locks the library around it
+    float* buf = malloc((FP_SECONDS * SAMPLE_RATE + FP_SCRATCH) * sizeof(float));
+    if(buf == NULL)
+        return 0;
+    float* scratch = buf + FP_SECONDS * SAMPLE_RATE;
+    Uint32 b = 0;
+    while(1)
     {
-        if(input2_mod == 1)
-            o += input2;
-        else if(input2_mod == 2)
-            o -= input2;
-        else if(input2_mod == 3)
-            o *= input2;
+        libraryLock();
+        const Uint32 count = store.count;
+        const Uint8 quit = fp_index.quit;
+        libraryUnlock();
+        if(quit == 1)
+            break;
+        while(b < count && fpNext(b, buf, scratch) == 0)
+            b++;
+        b++;
+        if(b >= count)
+        {
+            libraryLock();
+            fpSave();
+            libraryUnlock();
+            SDL_SemWait(fp_index.kick);
+            b = 0;
+        }
     }
+    loadImpulse(0);
+    free(buf);
+    return 0;
+}
 
-    // step oscillator phase
-    oscphase[oscid] += Hz(f)*reciprocal_sample_rate;
+void fpStart()
+{
+    if(fpInit() < 0)
+        return;
+    library_lock = SDL_CreateMutex();
+    index_lock = SDL_CreateMutex();
+    fp_index.kick = SDL_CreateSemaphore(0);
+    if(library_lock != NULL && index_lock != NULL && fp_index.kick != NULL)
+        fp_index.thread = SDL_CreateThread(fpThread, "borg_index", NULL);
+    if(fp_index.thread == NULL)
+        printf("Similar banks are not indexed in the background: %s\n", SDL_GetError());
+}
 
-    // return output
-    return o;
+void fpStop()
+{
+    if(fp_index.thread == NULL)
+        return;
+    libraryLock();
+    fp_index.quit = 1;
+    libraryUnlock();
+    fpKick();
+    SDL_WaitThread(fp_index.thread, NULL);
+    fp_index.thread = NULL;
+    fpSave();
 }
 
-#ifdef HERMITE_INTERPOLATE
-    float hermite4(float frac_pos, float xm1, float x0, float x1, float x2)
+Uint32 fpUpdate()
+{
+    // every stale bank here and now, for the command line
+    float* buf = malloc((FP_SECONDS * SAMPLE_RATE + FP_SCRATCH) * sizeof(float));
+    Uint32 n = 0;
+    if(buf == NULL || fpInit() < 0)
     {
-        // laurent de soras
-        const float c = (x1 - xm1) * 0.5f;
-        const float v = x0 - x1;
-        const float w = c + v;
-        const float a = w + v + (x2 - x0) * 0.5f;
-        const float b_neg = w + a;
-        return ((((a * frac_pos) - b_neg) * frac_pos + c) * frac_pos + x0);
+        free(buf);
+        return 0;
     }
-#endif
+    if(bankRoom(store.count + 1) == 1)
+        for(Uint32 b = 0; b < store.count; b++)
+            n += fpNext(b, buf, buf + FP_SECONDS * SAMPLE_RATE);
+    free(buf);
+    fpSave();
+    return n;
+}
 
-Uint32 eic = 0;
-Uint32 samstep = 0;
-Uint32 envelope_offset = 0;
-Uint32 crush_len = 0;
-Uint32 crush_index = 0;
-float  crush_value = 0.f;
-float a_i1, a_i2, a_o1, a_o2;
-float b_i1, b_i2, b_o1, b_o2;
-float c_i1, c_i2, c_o1, c_o2;
-float doFilters(float f)
+float fpDistance(const float* a, const float* b)
 {
-    // pre-calculate vars
-    static float r_samstep = 0.f;
-    if(samstep == 0)
+    v8f acc = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+    for(int i = 0; i < FP_DIM; i += 8)
     {
-        samstep = sample_len / 466;
-        r_samstep = 1.f/(float)samstep;
+        v8f x, y;
+        memcpy(&x, &a[i], sizeof(v8f));
+        memcpy(&y, &b[i], sizeof(v8f));
+        const v8f d = x - y;
+        acc += d * d;
     }
+    return (acc[0] + acc[4]) + (acc[1] + acc[5]) + (acc[2] + acc[6]) + (acc[3] + acc[7]);
+}
 
-    // crush
-    if(crush_len != 0)
-    {   
-        crush_index++;
-        if(crush_index >= crush_len)
-            crush_index = 0;
+Uint32 fpQuery(Uint32 bank, Uint32 k, Uint32* like)
+{
+    // the k indexed banks nearest to bank, nearest first
+    if(k == 0)
+        return 0;
+    if(k > FP_K)
+        k = FP_K;
+    if(fpInit() < 0)
+        return 0;
+    float v[FP_DIM] __attribute__ ((aligned(32)));
+    float d[FP_K];
+    Uint32 n = 0;
+    libraryLock();
+    if(fpRoom(store.count) == 1)
+    {
+        const Uint64 t0 = SDL_GetPerformanceCounter();
+        const Uint32 key = fpKey(bank);
+        if(key != 0 && fp_index.key[bank] == key)
+            memcpy(v, &fp_index.vec[(size_t)bank * FP_DIM], sizeof(v));
         else
-            return crush_value;
-    }
-
-    // biquad dials
-    const float a_b1 = synth[selected_bank].dial_state[32] * dial_scale[32];
-    const float a_b2 = synth[selected_bank].dial_state[33] * dial_scale[33];
-    const float a_b3 = synth[selected_bank].dial_state[34] * dial_scale[34];
-    const float a_a1 = synth[selected_bank].dial_state[35] * dial_scale[35];
-    const float a_a2 = synth[selected_bank].dial_state[36] * dial_scale[36];
-
-    const float b_b1 = synth[selected_bank].dial_state[37] * dial_scale[37];
-    const float b_b2 = synth[selected_bank].dial_state[38] * dial_scale[38];
-    const float b_b3 = synth[selected_bank].dial_state[39] * dial_scale[39];
-    const float b_a1 = synth[selected_bank].dial_state[40] * dial_scale[40];
-    const float b_a2 = synth[selected_bank].dial_state[41] * dial_scale[41];
-
-    const float c_b1 = synth[selected_bank].dial_state[42] * dial_scale[42];
-    const float c_b2 = synth[selected_bank].dial_state[43] * dial_scale[43];
-    const float c_b3 = synth[selected_bank].dial_state[44] * dial_scale[44];
-    const float c_a1 = synth[selected_bank].dial_state[45] * dial_scale[45];
-    const float c_a2 = synth[selected_bank].dial_state[46] * dial_scale[46];
-
-    // biquad 1
-    if(fZero(a_b1) != 1 || fZero(a_b2) != 1 || fZero(a_b3) != 1 || fZero(a_a1) != 1 || fZero(a_a2) != 1)
-    {
-        const float a_out =   a_b1 * f
-                            + a_b2 * a_i1
-                            + a_b3 * a_i2
-                            - a_a1 * a_o1
-                            - a_a2 * a_o2;
-        a_i2 = a_i1;
-        a_i1 = f;
-        a_o2 = a_o1;
-        a_o1 = a_out;
-
-        f = a_out;
-    }
-
-    // biquad 2
-    if(fZero(b_b1) != 1 || fZero(b_b2) != 1 || fZero(b_b3) != 1 || fZero(b_a1) != 1 || fZero(b_a2) != 1)
-    {
-        const float b_out =   b_b1 * f
-                            + b_b2 * b_i1
-                            + b_b3 * b_i2
-                            - b_a1 * b_o1
-                            - b_a2 * b_o2;
-        b_i2 = b_i1;
-        b_i1 = f;
-        b_o2 = b_o1;
-        b_o1 = b_out;
-
-        f = b_out;
-    }
-
-    // biquad 3
-    if(fZero(c_b1) != 1 || fZero(c_b2) != 1 || fZero(c_b3) != 1 || fZero(c_a1) != 1 || fZero(c_a2) != 1)
-    {
-        const float c_out =   c_b1 * f
-                            + c_b2 * c_i1
-                            + c_b3 * c_i2
-                            - c_a1 * c_o1
-                            - c_a2 * c_o2;
-        c_i2 = c_i1;
-        c_i1 = f;
-        c_o2 = c_o1;
-        c_o1 = c_out;
-
-        f = c_out;
+        {
+            // edited or not indexed yet, rendered here
+            float* buf = malloc((FP_SECONDS * SAMPLE_RATE + FP_SCRATCH) * sizeof(float));
+            if(buf == NULL)
+            {
+                libraryUnlock();
+                return 0;
+            }
+            bankLoad(bank);
+            fpRender(bank, buf, buf + FP_SECONDS * SAMPLE_RATE, v);
+            free(buf);
+        }
+
+        // insertion into the k best
+        const Uint64 t1 = SDL_GetPerformanceCounter();
+        for(Uint32 b = 0; b < store.count; b++)
+        {
+            if(b == bank || fp_index.key[b] == 0 || fp_index.key[b] != fpKey(b))
+                continue;
+            const float e = fpDistance(v, &fp_index.vec[(size_t)b * FP_DIM]);
+            if(n == k && e >= d[n-1])
+                continue;
+            Uint32 i = n < k ? n++ : n-1;
+            for(; i > 0 && d[i-1] > e; i--)
+                d[i] = d[i-1], like[i] = like[i-1];
+            d[i] = e;
+            like[i] = b;
+        }
+        const double f = (double)SDL_GetPerformanceFrequency();
+        printf("Banks like %u:", bank);
+        for(Uint32 i = 0; i < n; i++)
+            printf(" %u (%.2f)", like[i], sqrtf(d[i]));
+        printf("%s, %.2f ms scan, %.1f ms total\n", n == 0 ? " none indexed yet" : "", (SDL_GetPerformanceCounter()-t1) * 1e3 / f, (SDL_GetPerformanceCounter()-t0) * 1e3 / f);
     }
-    
-    // scale by lerped envelope
-#ifdef HERMITE_INTERPOLATE
-    if(envelope_offset == 0 || envelope_offset >= 463)
-        f *= wlerp(synth[selected_bank].envelope[envelope_offset], synth[selected_bank].envelope[envelope_offset+1], ((float)eic)*r_samstep);
-    else
-        f *= hermite4(((float)eic)*r_samstep, synth[selected_bank].envelope[envelope_offset-1], synth[selected_bank].envelope[envelope_offset], synth[selected_bank].envelope[envelope_offset+1], synth[selected_bank].envelope[envelope_offset+2]);
-#else
-    f *= wlerp(synth[selected_bank].envelope[envelope_offset], synth[selected_bank].envelope[envelope_offset+1], ((float)eic)*r_samstep);
+    libraryUnlock();
+    return n;
+}
+
+/*
+    library hot reload
+
+    On Linux a thread blocks on inotify for the directory of the
+    library, once the writes to it have been quiet for WATCH_QUIET
+    ms it wakes the event loop. The file is then mapped again and
+    only the banks that were decoded before are held against their
+    new record, the ones that differ are decoded again when next
+    selected. Banks never selected have nothing to update and
+    banks with unsaved edits keep them. Renders are cached by what
+    the bank holds, the old renders of a changed bank never match.
+*/
+#define WATCH_QUIET 100 // ms
+
+Uint32 reload_event = (Uint32)-1;
+Uint8 reload_pending = 0; // held back until the export finishes
+#ifdef __linux__
+int watch_fd = -1;
+char watch_name[256];
+struct stat watch_stat; // of the file as this process last left it
 #endif
 
-    // apply offsets
-    f -= synth[selected_bank].dial_state[48] * dial_scale[48];
+void watchStamp()
+{
+    // after saves and appends of this process, so their own events are passed over
+#ifdef __linux__
+    if(stat(store.path, &watch_stat) != 0)
+        memset(&watch_stat, 0x00, sizeof(struct stat));
+#endif
+}
 
-    // crush
-    if(crush_len != 0)
-        crush_value = f;
+int reloadLibrary()
+{
+    // 1 when the selected bank changed
+#ifdef __linux__
+    struct stat st;
+    char jfile[272];
+    snprintf(jfile, sizeof(jfile), "%s.journal", store.path);
+    if(store.map == NULL || stat(store.path, &st) != 0 || access(jfile, F_OK) == 0)
+        return 0; // mid-save, removing the journal wakes the watcher again
+    if(st.st_ino == watch_stat.st_ino && st.st_size == watch_stat.st_size &&
+       st.st_mtim.tv_sec == watch_stat.st_mtim.tv_sec && st.st_mtim.tv_nsec == watch_stat.st_mtim.tv_nsec)
+        return 0;
+    if(exporting == 1)
+    {
+        // the workers read synth[]
+        reload_pending = 1;
+        return 0;
+    }
+    struct sstore next;
+    if(storeOpen(&next, store.path, BANK_FORMAT, BANK_RECORD) < 0)
+        return 0;
+    if(next.count == 0 || bankRoom(next.count) < 0)
+    {
+        storeClose(&next);
+        return 0;
+    }
 
-    // increment envelope stepper
-    eic++;
-    if(eic > samstep)
+    Uint8 r[BANK_RECORD];
+    Uint32 changed = 0;
+    Uint8 selected = 0;
+    for(Uint32 i = 0; i < store.count; i++)
     {
-        eic = 0;
-        if(envelope_offset < 465)
-            envelope_offset++;
+        if(i >= next.count)
+        {
+            bank_ready[i] = 0;
+            continue;
+        }
+        if(store.dirty[i] == 1)
+        {
+            next.dirty[i] = 1;
+            continue;
+        }
+        if(bank_ready[i] == 0)
+            continue;
+        bankEncode(&synth[i], r);
+        if(memcmp(r, next.base + (size_t)i * BANK_RECORD, BANK_RECORD) == 0)
+            continue;
+        bank_ready[i] = 0;
+        changed++;
+        selected |= i == selected_bank;
+    }
+    if(changed > 0 || next.count != store.count)
+        printf("%s changed, %u banks reloaded, %u banks.\n", store.path, changed, next.count);
+    if(next.count < store.count)
+        changed++;
+    libraryLock();
+    storeClose(&store);
+    store = next;
+    watch_stat = st;
+    if(selected_bank >= store.count)
+    {
+        selected_bank = store.count-1;
+        selected = 1;
     }
+    bankLoad(selected_bank);
+    libraryUnlock();
+    fpKick();
+    if(changed > 0)
+        historyClear();
+    return selected;
+#else
+    return 0;
+#endif
+}
 
-    return f;
+#ifdef __linux__
+int watchThread(void* unused)
+{
+    // blocks in poll, the timeout only runs while writes are settling
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const size_t len = strlen(watch_name);
+    struct pollfd p = {watch_fd, POLLIN, 0};
+    Uint8 hit = 0;
+    while(1)
+    {
+        const int r = poll(&p, 1, hit == 1 ? WATCH_QUIET : -1);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r < 0)
+            return 0;
+        if(r == 0)
+        {
+            SDL_Event e;
+            memset(&e, 0x00, sizeof(SDL_Event));
+            e.type = reload_event;
+            SDL_PushEvent(&e);
+            hit = 0;
+            continue;
+        }
+        const ssize_t n = read(watch_fd, buf, sizeof(buf));
+        if(n <= 0)
+            return 0;
+        for(ssize_t i = 0; i < n;)
+        {
+            // the library or its journal
+            const struct inotify_event* e = (const struct inotify_event*)&buf[i];
+            if((e->mask & IN_Q_OVERFLOW) != 0 || (e->len > 0 && strncmp(e->name, watch_name, len) == 0 && (e->name[len] == 0x00 || strcmp(&e->name[len], ".journal") == 0)))
+                hit = 1;
+            i += sizeof(struct inotify_event) + e->len;
+        }
+    }
 }
+#endif
 
-void doSynth(Uint8 play)
+void watchStart()
 {
-    a_i1=0.f, a_i2=0.f, a_o1=0.f, a_o2=0.f;
-    b_i1=0.f, b_i2=0.f, b_o1=0.f, b_o2=0.f;
-    c_i1=0.f, c_i2=0.f, c_o1=0.f, c_o2=0.f;
-    samstep = 0;
-    eic = 0;
-    crush_index = 0;
-    crush_value = 0.f;
-    crush_len = synth[selected_bank].dial_state[49] * dial_scale[49] * 33;
-    envelope_offset = synth[selected_bank].dial_state[47] * dial_scale[47] * 466;
-    for(int i = 0; i < 8; i++)
-        oscphase[i] = 0.f;
-    setSampleLen(synth[selected_bank].seclen);
-    for(int i = 0; i < SAMPLE_RATE*synth[selected_bank].seclen; i++)
-    {
-        const float o8 = doOsc(8, 0.f, 0.f);
-        const float o7 = doOsc(7, o8, 0.f);
-        const float o4 = doOsc(4, o8, 0.f);
-        const float o3 = doOsc(3, o7, o4);
-        const float o6 = doOsc(6, o7, 0.f);
-        const float o2 = doOsc(2, o6, o3);
-        const float o5 = doOsc(5, o6, 0.f);
-        const float o1 = doOsc(1, o5, o2);
-        sample[i] = quantise_float(doFilters(o1));
+#ifdef __linux__
+    // the directory is watched, a file replaced by a rename is seen too
+    if(store.map == NULL)
+        return;
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s", store.path);
+    char* slash = strrchr(dir, '/');
+    snprintf(watch_name, sizeof(watch_name), "%s", slash != NULL ? slash+1 : dir);
+    if(slash != NULL)
+        slash[1] = 0x00;
+    else
+        sprintf(dir, ".");
+    watch_fd = inotify_init1(IN_CLOEXEC);
+    if(watch_fd < 0 || inotify_add_watch(watch_fd, dir, IN_MODIFY|IN_CLOSE_WRITE|IN_MOVED_TO|IN_CREATE|IN_DELETE) < 0)
+    {
+        printf("%s is not watched, use Load after changing it.\n", store.path);
+        if(watch_fd >= 0)
+            close(watch_fd);
+        watch_fd = -1;
+        return;
     }
-    
-    if(play == 1)
-        playSample();
+    reload_event = SDL_RegisterEvents(1);
+    watchStamp();
+    SDL_Thread* t = SDL_CreateThread(watchThread, "watch", NULL);
+    if(t != NULL)
+        SDL_DetachThread(t);
+#endif
 }
 
 struct sui
@@ -765,14 +4138,6 @@ struct sui ui;
 void loadAssets(SDL_Surface* screen)
 {
     memset(&ui, 0x00, sizeof(struct sui));
-    memset(&synth, 0x00, sizeof(struct ssynth));
-
-    for(int i = 0; i < 256; i++)
-    {
-        for(int j = 0; j < 466; j++)
-            synth[i].envelope[j] = 0.5f;
-        synth[i].seclen = 3;
-    }
 
     dial_rect[0] = (SDL_Rect){10, 19, 19, 19};
     dial_rect[1] = (SDL_Rect){34, 19, 19, 19};
@@ -857,22 +4222,223 @@ void loadAssets(SDL_Surface* screen)
     mul_rect[7] = (SDL_Rect){115, 27, 12, 12};
     fm_rect[7]  = (SDL_Rect){108, 40, 20, 12};
 
-    am_rect[8]  = (SDL_Rect){108, 70, 20, 12};
-    mul_rect[8] = (SDL_Rect){115, 83, 12, 12};
-    fm_rect[8]  = (SDL_Rect){108, 96, 20, 12};
+    am_rect[8]  = (SDL_Rect){108, 70, 20, 12};
+    mul_rect[8] = (SDL_Rect){115, 83, 12, 12};
+    fm_rect[8]  = (SDL_Rect){108, 96, 20, 12};
+
+    am_rect[9]  = (SDL_Rect){17, 55, 20, 12};
+    mul_rect[9] = (SDL_Rect){50, 41, 12, 12};
+    fm_rect[9]  = (SDL_Rect){74, 55, 20, 12};
+
+    bb = SDL_RGBA32Surface(screen->w, screen->h);
+    s_bg = surfaceFromData(&bmp_bg[0], screen->w, screen->h);
+    s_icon = surfaceFromData((Uint32*)&icon_image.pixel_data[0], 16, 16);
+    s_rm = surfaceFromData((Uint32*)&rm_image.pixel_data[0], 20, 12);
+    s_tm = surfaceFromData((Uint32*)&tm_image.pixel_data[0], 20, 12);
+    s_plus = surfaceFromData((Uint32*)&plus_image.pixel_data[0], 12, 12);
+    s_minus = surfaceFromData((Uint32*)&minus_image.pixel_data[0], 12, 12);
+    s_mul = surfaceFromData((Uint32*)&mul_image.pixel_data[0], 12, 12);
+}
+
+/*
+    spectrum view
+
+    A switches the scope panel between the oscilloscope, a
+    spectrogram and a spectrum. Both read the render through
+    SPEC_FFT point frames, on SPEC_ROWS log spaced rows from
+    SPEC_LOW Hz to nyquist, in dB under a full scale sine.
+
+    The spectrogram has one frame per column of the scope, at
+    the same zoom, and keeps them as bytes with the render key
+    and zoom they came from. A redraw only computes columns it
+    does not have yet and at most SPEC_BUDGET of them, a tick
+    asks for the next redraw until the panel is complete, so
+    the cost of a frame does not grow with the render length.
+    While the sample plays a tick every SPEC_FRAME ms moves the
+    playhead, the spectrum is then the frame under it and the
+    average of the spectrogram columns otherwise.
+*/
+#define SPEC_FFT    2048
+#define SPEC_COLS   466
+#define SPEC_ROWS   126
+#define SPEC_LOW    30.f
+#define SPEC_RANGE  84.f // dB shown
+#define SPEC_BUDGET 128  // columns computed per redraw
+#define SPEC_FRAME  16   // ms between redraws while playing, about 60 fps
+
+struct sspectrum
+{
+    struct sfft fft;
+    Uint8 ready;
+    float window[SPEC_FFT];
+    Uint16 row[SPEC_ROWS+1];    // first bin of each row, row 0 at the bottom
+    float norm;                 // 1 / power of a full scale sine
+    float* buf;                 // frame, then the bins
+    Uint32 palette[256];
+    Uint64 key;                 // render_key of the columns
+    float scale;                // samples per column
+    Uint32 len;
+    Uint32 done;                // columns computed, left to right
+    Uint8 col[SPEC_COLS][SPEC_ROWS];
+    Uint32 play_index;          // sample_index when it last moved
+    Uint64 play_time;
+};
+struct sspectrum spectrum;
+Uint8 view = 0; // 0 oscilloscope, 1 spectrogram, 2 spectrum
+SDL_TimerID view_timer = 0;
+
+int specInit(SDL_Surface* s)
+{
+    if(spectrum.ready == 1)
+        return 1;
+    spectrum.buf = malloc((SPEC_FFT*2 + 2) * sizeof(float));
+    if(spectrum.buf == NULL || fftInit(&spectrum.fft, SPEC_FFT) < 0)
+    {
+        free(spectrum.buf);
+        spectrum.buf = NULL;
+        return -1;
+    }
+    for(Uint32 i = 0; i < SPEC_FFT; i++)
+        spectrum.window[i] = 0.5f - 0.5f * cosf(6.283185307f * i / SPEC_FFT);
+    const float bin = (float)SAMPLE_RATE / SPEC_FFT, nyquist = SAMPLE_RATE / 2;
+    for(Uint32 r = 0; r <= SPEC_ROWS; r++)
+        spectrum.row[r] = SPEC_LOW * powf(nyquist / SPEC_LOW, (float)r / SPEC_ROWS) / bin + 0.5f;
+    const float a = 128.f * SPEC_FFT / 4.f; // a hann window halves the peak of a bin centred sine
+    spectrum.norm = 1.f / (a*a);
+
+    // scope background, scope line, near white
+    Uint8 r, g, b;
+    SDL_GetRGB(scopecolor, s->format, &r, &g, &b);
+    for(int i = 0; i < 256; i++)
+    {
+        const float t = i < 160 ? i / 160.f : (i - 160) / 95.f;
+        if(i < 160)
+            spectrum.palette[i] = SDL_MapRGB(s->format, r + (220-r)*t, g + (95-g)*t, b + (117-b)*t);
+        else
+            spectrum.palette[i] = SDL_MapRGB(s->format, 220 + 35*t, 95 + 145*t, 117 + 93*t);
+    }
+    spectrum.ready = 1;
+    return 1;
+}
+
+void specFrame(Uint32 centre, Uint8* out)
+{
+    // the frame around centre, zero outside the render, as a byte per row
+    float* w = spectrum.buf;
+    float* re = w + SPEC_FFT;
+    float* im = re + SPEC_FFT/2 + 1;
+    const Sint64 start = (Sint64)centre - SPEC_FFT/2;
+    for(Uint32 i = 0; i < SPEC_FFT; i++)
+    {
+        const Sint64 j = start + i;
+        w[i] = j >= 0 && j < sample_len ? sample[j] * spectrum.window[i] : 0.f;
+    }
+    fftReal(&spectrum.fft, w, re, im);
+    for(Uint32 r = 0; r < SPEC_ROWS; r++)
+    {
+        // the loudest bin of the row, low rows share a bin
+        const Uint32 end = spectrum.row[r+1] > spectrum.row[r] ? spectrum.row[r+1] : spectrum.row[r] + 1;
+        float p = 0.f;
+        for(Uint32 k = spectrum.row[r]; k < end && k <= SPEC_FFT/2; k++)
+        {
+            const float q = re[k]*re[k] + im[k]*im[k];
+            p = q > p ? q : p;
+        }
+        const float v = (3.0103f * log2f(p * spectrum.norm + 1e-12f) + SPEC_RANGE) * (255.f / SPEC_RANGE);
+        out[r] = v < 0.f ? 0 : (v > 255.f ? 255 : v);
+    }
+}
+
+Uint8 specUpdate()
+{
+    // 1 once every column of the render is there
+    const float sc = ((float)synth[selected_bank].seclen * (float)SAMPLE_RATE) / scope_zoom;
+    if(spectrum.key != render_key || spectrum.scale != sc || spectrum.len != sample_len)
+    {
+        spectrum.key = render_key;
+        spectrum.scale = sc;
+        spectrum.len = sample_len;
+        spectrum.done = 0;
+    }
+    Uint32 end = spectrum.done + SPEC_BUDGET;
+    if(end > SPEC_COLS)
+        end = SPEC_COLS;
+    for(; spectrum.done < end; spectrum.done++)
+        specFrame(((float)spectrum.done)*sc, spectrum.col[spectrum.done]);
+    return spectrum.done == SPEC_COLS;
+}
+
+Uint8 specPlaying()
+{
+    return SDL_GetAudioStatus() == SDL_AUDIO_PLAYING && sample_index < sample_len;
+}
 
-    am_rect[9]  = (SDL_Rect){17, 55, 20, 12};
-    mul_rect[9] = (SDL_Rect){50, 41, 12, 12};
-    fm_rect[9]  = (SDL_Rect){74, 55, 20, 12};
+Uint32 specPlayhead()
+{
+    // sample_index runs a device buffer ahead of what is heard and only moves once per callback
+    const Uint32 si = sample_index;
+    const Uint64 now = SDL_GetPerformanceCounter();
+    if(si != spectrum.play_index)
+    {
+        spectrum.play_index = si;
+        spectrum.play_time = now;
+    }
+    Uint64 pos = si > sdlaudioformat.samples ? si - sdlaudioformat.samples : 0;
+    pos += (now - spectrum.play_time) * sdlaudioformat.freq / SDL_GetPerformanceFrequency();
+    return pos < si ? pos : si;
+}
 
-    bb = SDL_RGBA32Surface(screen->w, screen->h);
-    s_bg = surfaceFromData(&bmp_bg[0], screen->w, screen->h);
-    s_icon = surfaceFromData((Uint32*)&icon_image.pixel_data[0], 16, 16);
-    s_rm = surfaceFromData((Uint32*)&rm_image.pixel_data[0], 20, 12);
-    s_tm = surfaceFromData((Uint32*)&tm_image.pixel_data[0], 20, 12);
-    s_plus = surfaceFromData((Uint32*)&plus_image.pixel_data[0], 12, 12);
-    s_minus = surfaceFromData((Uint32*)&minus_image.pixel_data[0], 12, 12);
-    s_mul = surfaceFromData((Uint32*)&mul_image.pixel_data[0], 12, 12);
+Uint8 specBusy()
+{
+    // the panel wants another redraw
+    return view != 0 && (specPlaying() == 1 || spectrum.done < SPEC_COLS);
+}
+
+void specDraw(SDL_Surface* s)
+{
+    if(sample == NULL || sample_len == 0 || specInit(s) < 0)
+        return;
+    const Uint8 complete = specUpdate();
+    const Uint8 playing = specPlaying();
+    const Uint32 bottom = scope_rect.y + scope_rect.h - 1;
+    if(view == 1)
+    {
+        for(Uint32 i = 0; i < spectrum.done; i++)
+            for(Uint32 r = 0; r < SPEC_ROWS; r++)
+                setpixel(s, scope_rect.x + i, bottom - r, spectrum.palette[spectrum.col[i][r]]);
+        if(playing == 1)
+        {
+            const float x = specPlayhead() / spectrum.scale;
+            if(x < SPEC_COLS)
+                linergb(s, scope_rect.x + x, scope_rect.y, scope_rect.x + x, bottom, 255, 255, 255);
+        }
+    }
+    else
+    {
+        Uint8 v[SPEC_ROWS];
+        if(playing == 1)
+            specFrame(specPlayhead(), v);
+        else
+        {
+            for(Uint32 r = 0; r < SPEC_ROWS; r++)
+            {
+                Uint32 sum = 0;
+                for(Uint32 i = 0; i < spectrum.done; i++)
+                    sum += spectrum.col[i][r];
+                v[r] = spectrum.done > 0 ? sum / spectrum.done : 0;
+            }
+        }
+        Uint32 lx = scope_rect.x, ly = bottom - v[0] * (scope_rect.h-1) / 255;
+        for(Uint32 r = 1; r < SPEC_ROWS; r++)
+        {
+            const Uint32 nx = scope_rect.x + r * (SPEC_COLS-1) / (SPEC_ROWS-1);
+            const Uint32 ny = bottom - v[r] * (scope_rect.h-1) / 255;
+            linergb(s, lx, ly, nx, ny, 220, 95, 117);
+            lx = nx, ly = ny;
+        }
+    }
+    if((complete == 0 || playing == 1) && view_timer == 0)
+        view_timer = SDL_AddTimer(SPEC_FRAME, exportTick, NULL);
 }
 
 void render(SDL_Surface* screen)
@@ -895,11 +4461,21 @@ void render(SDL_Surface* screen)
         sprintf(val, "%d", selected_bank);
         drawText(bb, val, 36, 418, 0);
     }
-    else
+    else if(selected_bank < 1000)
     {
         sprintf(val, "%d", selected_bank);
         drawText(bb, val, 33, 418, 0);
     }
+    else if(selected_bank < 10000)
+    {
+        sprintf(val, "%d", selected_bank);
+        drawText(bb, val, 30, 418, 0);
+    }
+    else
+    {
+        sprintf(val, "%d", selected_bank);
+        drawText(bb, val, 27, 418, 0);
+    }
 
     // draw sec len
     if(synth[selected_bank].seclen < 10)
@@ -923,7 +4499,8 @@ void render(SDL_Surface* screen)
         const Uint32 nx = 7+i;
 
         // aliased
-        const Uint32 sa = (sample[i2]/2);
+        const float sv = sample[i2] < -128.f ? -128.f : (sample[i2] > 127.f ? 127.f : sample[i2]);
+        const Uint32 sa = ((Sint32)sv)/2;
 
         // anti-aliased (sounds like a good idea, but not a good idea.)
         // float sa = 0.f;
@@ -937,8 +4514,11 @@ void render(SDL_Surface* screen)
 
         // draw scope
         const Uint32 ny = 349+sa;
-        linergb(bb, lx, ly, nx, ny, 220, 95, 117);
-        lx = nx, ly = ny;
+        if(view == 0)
+        {
+            linergb(bb, lx, ly, nx, ny, 220, 95, 117);
+            lx = nx, ly = ny;
+        }
 
         // envelope
         linergb(bb, 7+i, 280, 7+i, 280-(126*synth[selected_bank].envelope[i]), 220, 95, 117);
@@ -946,10 +4526,37 @@ void render(SDL_Surface* screen)
     // end scope (important to illustrate amp offset clicking)
     if(ly != 349)
         linergb(bb, lx, ly, 472, 349, 220, 95, 117);
+    if(view != 0)
+        specDraw(bb);
     
     if(envelope_enabled == 1)
         setColourLightness(bb, envelope_rect, scopecolor, 33);
 
+    // reverb & envelope interpolation
+    int sl = 0;
+    val[0] = 0x00;
+    if(synth[selected_bank].ir_state > 0)
+    {
+        if(impulse_index == synth[selected_bank].ir_state && impulse.parts > 0)
+            sl += sprintf(val, "Reverb: ir-%d.wav %.0f%%  ", synth[selected_bank].ir_state, synth[selected_bank].ir_mix*100.f);
+        else
+            sl += sprintf(val, "Reverb: ir-%d.wav not found  ", synth[selected_bank].ir_state);
+    }
+    if(exporting == 1)
+        sl += sprintf(val+sl, "Exporting %d/%d  ", SDL_AtomicGet(&export_task.written), export_task.banks);
+    if(synth[selected_bank].env_interp == 1)
+        sl += sprintf(val+sl, "Hermite envelope  ");
+    if(export_format == SAMPLE_S16)
+        sl += sprintf(val+sl, "Export: 16-bit");
+    else if(export_format == SAMPLE_F32)
+        sl += sprintf(val+sl, "Export: 32-bit float");
+    else if(export_format == SAMPLE_FLAC)
+        sl += sprintf(val+sl, "Export: FLAC");
+    if(export_rate != 0)
+        sl += sprintf(val+sl, "%s%g kHz %s", export_format == SAMPLE_U8 ? "Export: " : " ", export_rate / 1000.f, resample_names[export_quality]);
+    if(sl > 0)
+        drawText(bb, val, 11, 288, 1);
+
     // dial hover & state
     const Uint32 hh = dial_rect[0].h/2; // no point making this static (hack: all the same width)
     for(int i = 0; i < 50; i++)
@@ -968,7 +4575,15 @@ void render(SDL_Surface* screen)
         {
             ih=1;
             
-            sprintf(val, "Value: %+.2f", synth[selected_bank].dial_state[i] * dial_scale[i]);
+            int vl = sprintf(val, "Value: %+.2f", synth[selected_bank].dial_state[i] * dialScale(i));
+            const Sint32 osc = dialOscillator(i);
+            if(osc >= 0 && synth[selected_bank].hires_state[osc] == 1)
+                vl += sprintf(val+vl, "  HiRes");
+            if(osc >= 0 && synth[selected_bank].unison_state[osc] > 0)
+                vl += sprintf(val+vl, "  Unison: %d D:%.2f S:%.2f", synth[selected_bank].unison_state[osc]+1, synth[selected_bank].detune_state[osc], synth[selected_bank].spread_state[osc]);
+            const Sint32 ms = getModSlot(i, 0);
+            if(ms >= 0)
+                sprintf(val+vl, "  %s %.2fHz %+.2f", mod_names[synth[selected_bank].mod_type[ms]], modRate(synth[selected_bank].mod_rate[ms]), synth[selected_bank].mod_depth[ms]);
             drawText(bb, val, 11, 397, 1);
 
             if(select_mode == 0)
@@ -1081,33 +4696,33 @@ void render(SDL_Surface* screen)
                 themeon = 0;
             }
         }
-        else
+        else if(theme_type == 2)
         {
+            // one hue cycle over EXPORT_FLASH ms, redrawn by the export tick
             if(st == 0)
                 st = SDL_GetTicks();
-            static float h = 0, s = 0.1f;
-            if(theme_type == 2)
+            const float h = (float)(SDL_GetTicks() - st) / EXPORT_FLASH;
+            if(h >= 1.f)
             {
-                setHueSat(bb, export_rect, h, 0.5f);
-                h += 0.002f;
+                st = 0;
+                themeon = 0;
             }
             else
             {
-                setHueSat(bb, (SDL_Rect){0, 0, bb->w, bb->h}, h, s);
-                h += 0.002f;
+                setHueSat(bb, export_rect, h, 0.5f);
             }
+        }
+        else
+        {
+            if(st == 0)
+                st = SDL_GetTicks();
+            static float h = 0, s = 0.1f;
+            setHueSat(bb, (SDL_Rect){0, 0, bb->w, bb->h}, h, s);
+            h += 0.002f;
             
             if(h >= 1.0f)
             {
-                if(theme_type == 2)
-                {
-                    s = 0.1f;
-                    themeon = 0;
-                }
-                else
-                {
-                    s += 0.1f;
-                }
+                s += 0.1f;
                 h = 0.f;
             }
             else if(s >= 0.9f)
@@ -1132,13 +4747,242 @@ void render(SDL_Surface* screen)
         SDL_CursorPointer(0);
 }
 
+void benchFixed()
+{
+    // render every bank that has dials set with both paths and
+    // measure the fixed-point output against the float reference
+    float* ref = malloc(MAX_SAMPLE*sizeof(float));
+    if(ref == NULL)
+        return;
+    const Uint32 sb = selected_bank;
+    const double freq = SDL_GetPerformanceFrequency();
+    double tfl = 0.0, tfx = 0.0, terr = 0.0, tref = 0.0, tmax = 0.0;
+    Uint32 banks = 0;
+    Uint64 tlen = 0;
+
+    printf("Fixed-point benchmark, reverb and hi-res harmonics above %d are float only.\n\n", MAXRESOLUTION);
+    printf("bank  secs  float ms  fixed ms  speedup  max err  rms err  snr dB\n");
+    for(Uint32 b = 0; b < store.count; b++)
+    {
+        selected_bank = b;
+        if(bankUsed(b) == 0)
+            continue;
+        bankLoad(b);
+        const Uint8 ir = synth[b].ir_state;
+        synth[b].ir_state = 0;
+
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        synthFloat();
+        Uint64 t1 = SDL_GetPerformanceCounter();
+        memcpy(ref, sample, sample_len*sizeof(float));
+        synthFixed();
+        Uint64 t2 = SDL_GetPerformanceCounter();
+        synth[b].ir_state = ir;
+
+        // errors in 8-bit steps of the clipped output
+        double emax = 0.0, err = 0.0, sig = 0.0;
+        for(Uint32 i = 0; i < sample_len; i++)
+        {
+            const double r = fminf(fmaxf(ref[i], -128.f), 127.f);
+            const double e = fminf(fmaxf(sample[i], -128.f), 127.f) - r;
+            if(fabs(e) > emax)
+                emax = fabs(e);
+            err += e*e;
+            sig += r*r;
+        }
+        const double fl = (double)(t1-t0) * 1000.0 / freq;
+        const double fx = (double)(t2-t1) * 1000.0 / freq;
+        printf("%4d  %4d  %8.1f  %8.1f  %6.2fx  %7.2f  %7.3f  %6.1f\n", b+1, synth[b].seclen, fl, fx, fl / fx, emax, sqrt(err / sample_len), err > 0.0 ? 10.0 * log10(sig / err) : 99.9);
+
+        tfl += fl, tfx += fx, terr += err, tref += sig;
+        tlen += sample_len;
+        if(emax > tmax)
+            tmax = emax;
+        banks++;
+    }
+
+    if(banks > 0)
+        printf("\n%d banks  float %.1f ms  fixed %.1f ms  speedup %.2fx  max err %.2f  rms err %.3f  snr %.1f dB\n", banks, tfl, tfx, tfl / tfx, tmax, sqrt(terr / tlen), terr > 0.0 ? 10.0 * log10(tref / terr) : 99.9);
+    else
+        printf("No banks to benchmark, set some dials and save first.\n");
+
+    selected_bank = sb;
+    free(ref);
+}
+
+int parseBank(const char* s)
+{
+    // numbered from 0 as the UI and the export files, -1 when it is not a bank
+    char* end;
+    const long b = strtol(s, &end, 10);
+    if(end == s || *end != 0x00 || b < 0 || b >= (long)store.count)
+    {
+        printf("Bank must be between 0 and %u.\n", store.count-1);
+        return -1;
+    }
+    return b;
+}
+
+Uint32 parseFormat(const char* s)
+{
+    if(strcmp(s, "flac") == 0)
+        return SAMPLE_FLAC;
+    else if(strcmp(s, "f32") == 0)
+        return SAMPLE_F32;
+    else if(strcmp(s, "s16") == 0)
+        return SAMPLE_S16;
+    return SAMPLE_U8;
+}
+
+Uint32 parseQuality(const char* s)
+{
+    for(Uint32 i = 0; i <= RESAMPLE_BEST; i++)
+        if(strcmp(s, resample_names[i]) == 0)
+            return i;
+    return RESAMPLE_GOOD;
+}
+
 int main(int argc, char *argv[])
 {
     // egg
     if(argc == 2){egg = atoi(argv[1]);}
 
+    // export and library options, taken out before the modes below are matched
+    int an = 1;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--rate") == 0 && i+1 < argc)
+            export_rate = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--quality") == 0 && i+1 < argc)
+            export_quality = parseQuality(argv[++i]);
+        else if(strcmp(argv[i], "--library") == 0 && i+1 < argc)
+            library_path = argv[++i];
+        else
+            argv[an++] = argv[i];
+    }
+    argc = an;
+    if(export_rate == SAMPLE_RATE)
+        export_rate = 0;
+
+    // command line modes, no window
+    const Uint8 bench = argc == 2 && strcmp(argv[1], "--bench") == 0;
+    const Uint8 stream = (argc == 5 || argc == 6) && strcmp(argv[1], "--stream") == 0;
+    const Uint8 expall = (argc == 2 || argc == 3) && strcmp(argv[1], "--export-all") == 0;
+    const Uint8 multi = (argc == 7 || argc == 8) && strcmp(argv[1], "--multisample") == 0;
+    const Uint8 import = argc >= 3 && strcmp(argv[1], "--import") == 0;
+    const Uint8 sweep = (argc == 4 || argc == 5) && strcmp(argv[1], "--sweep") == 0;
+    const Uint8 match = (argc == 4 || argc == 5) && strcmp(argv[1], "--match") == 0;
+    const Uint8 similar = (argc == 3 || argc == 4) && strcmp(argv[1], "--similar") == 0;
+    if(bench == 1 || stream == 1 || expall == 1 || multi == 1 || import == 1 || sweep == 1 || match == 1 || similar == 1)
+    {
+        if(SDL_Init(SDL_INIT_AUDIO) < 0 || initMonoAudio(SAMPLE_RATE) < 0)
+        {
+            fprintf(stderr, "ERROR: SDL audio: %s\n", SDL_GetError());
+            return 1;
+        }
+        appdir = SDL_GetPrefPath("voxdsp", "borger3");
+        loadState();
+        reciprocal_sample_rate = 1.f/(float)SAMPLE_RATE;
+        fftInit(&hires_fft, HIRES_TABLE);
+        initFixed();
+
+        int r = 0;
+        if(bench == 1)
+        {
+            benchFixed();
+        }
+        else if(match == 1)
+        {
+            // borg --match <target.wav> <bank> [generations]
+            const int bank = parseBank(argv[3]);
+            if(bank < 0)
+                r = 1;
+            else if(matchBank(argv[2], bank, argc == 5 ? (Uint32)atoi(argv[4]) : MATCH_GENERATIONS) == 1)
+                saveState();
+            else
+                r = 1;
+        }
+        else if(similar == 1)
+        {
+            // borg --similar <bank> [count]
+            const int bank = parseBank(argv[2]);
+            char* end = NULL;
+            const long k = argc == 4 ? strtol(argv[3], &end, 10) : FP_K;
+            if(bank < 0)
+                r = 1;
+            else if(k < 1 || k > FP_K || (end != NULL && *end != 0x00))
+            {
+                printf("Count must be between 1 and %d.\n", FP_K);
+                r = 1;
+            }
+            else
+            {
+                const Uint64 t0 = SDL_GetPerformanceCounter();
+                const Uint32 n = fpUpdate();
+                if(n > 0)
+                    printf("Indexed %u banks in %.1f s.\n", n, (double)(SDL_GetPerformanceCounter()-t0) / SDL_GetPerformanceFrequency());
+                Uint32 like[FP_K];
+                fpQuery(bank, k, like);
+            }
+        }
+        else if(import == 1)
+        {
+            // borg --import <banks.lib|bank.save> ...
+            for(int i = 2; i < argc; i++)
+                if(importBanks(argv[i]) < 0)
+                    r = 1;
+            printf("%s has %u banks.\n", store.path, store.count);
+        }
+        else if(expall == 1 || multi == 1 || sweep == 1)
+        {
+            // borg --export-all [u8|s16|f32|flac]
+            // borg --multisample <bank> <root> <low> <high> <step> [u8|s16|f32|flac]
+            // borg --sweep <spec> <dir> [u8|s16|f32|flac]
+            Uint32 format = export_format;
+            if(argc == 3 || argc == 8 || (sweep == 1 && argc == 5))
+                format = parseFormat(argv[argc-1]);
+            int banks = 0;
+            if(expall == 1)
+                banks = exportAllStart(format);
+            else if(sweep == 1)
+                banks = sweepStart(argv[2], argv[3], format);
+            else if(parseBank(argv[2]) >= 0)
+                banks = multiStart(parseBank(argv[2]), atoi(argv[3]), atoi(argv[4]), atoi(argv[5]), atoi(argv[6]), format);
+            if(banks == 0)
+                printf(expall == 1 ? "No banks to export, set some dials and save first.\n" : "No notes to export, check the bank and key range.\n");
+            while(exporting == 1 && exportDone() == 0)
+            {
+                printf("\r%d / %d %s", SDL_AtomicGet(&export_task.written), banks, multi == 1 ? "notes" : sweep == 1 ? "patches" : "banks");
+                fflush(stdout);
+                SDL_Delay(100);
+            }
+            printf("\r");
+            exportFinish();
+            r = banks < 0 || SDL_AtomicGet(&export_task.failed) > 0;
+        }
+        else
+        {
+            // borg --stream <bank> <seconds> <file.wav> [u8|s16|f32|flac]
+            const int bank = parseBank(argv[2]);
+            Uint32 format = export_format;
+            if(argc == 6)
+                format = parseFormat(argv[5]);
+            if(bank < 0)
+                r = 1;
+            else
+            {
+                selected_bank = bank;
+                bankLoad(selected_bank);
+                r = streamRender(argv[4], atoi(argv[3]), format) < 0;
+            }
+        }
+        arenaFree(&render_arena);
+        SDL_Quit();
+        return r;
+    }
+
     // init sdl
-    if(SDL_Init(SDL_INIT_VIDEO|SDL_INIT_AUDIO|SDL_INIT_EVENTS) < 0)
+    if(SDL_Init(SDL_INIT_VIDEO|SDL_INIT_AUDIO|SDL_INIT_EVENTS|SDL_INIT_TIMER) < 0)
     {
         fprintf(stderr, "ERROR: SDL_Init(): %s\n", SDL_GetError());
         return 1;
@@ -1194,6 +5038,23 @@ int main(int argc, char *argv[])
     printf("Reset envelope: right click on it\n");
     printf("Scroll dial sensitivity selection: right click, three sensitvity options\n");
     printf("Reset/disable multiple selection button: right click on button\n");
+    printf("Unison: hold U, D or S and scroll over an oscillator to set its voices, detune or spread\n");
+    printf("HiRes: press H over an oscillator to switch it to the IFFT engine, up to %d harmonics\n", MAXHIRES);
+    printf("Reverb: hold V and scroll to select %sir-N.wav, hold W and scroll to set the wet mix\n", appdir);
+    printf("Export format: press B to cycle between 8-bit, 16-bit and 32-bit float WAV and 16-bit FLAC\n");
+    printf("Envelope: press I to switch between linear and hermite interpolation\n");
+    printf("Modulation: hold M, R or T and scroll over any dial to set the depth, rate or type of its LFO/envelope\n");
+    printf("Export all: press E to export every used bank in the background, or run borg --export-all [u8|s16|f32|flac]\n");
+    printf("Export rate: press X to cycle between %d, 48000 and 96000 Hz and Q for the resampler quality, or add --rate <hz> [--quality fast|good|best] to any command line export\n", SAMPLE_RATE);
+    printf("Multisample: press K to export the selected bank from key %d to %d with an SFZ, or run borg --multisample <bank> <root> <low> <high> <step> [u8|s16|f32|flac]\n", MULTI_LOW, MULTI_HIGH);
+    printf("Sweep: run borg --sweep <spec> <dir> [u8|s16|f32|flac] to render every combination of the dial and button ranges in a spec file on all cores, with a manifest.csv of the values\n");
+    printf("Match: run borg --match <target.wav> <bank> [generations] to evolve the dials and routing of a bank toward the sound of a WAV and save the closest patch into it\n");
+    printf("Spectrum: press A to switch the scope between the oscilloscope, a spectrogram and a spectrum, both follow playback and the scope zoom\n");
+    printf("Similar: press F to jump to the bank that sounds most like the selected one and again for the next most alike, or run borg --similar <bank> [count]\n");
+    printf("Library: banks are kept in %sbanks.lib, paged in as they are viewed, step right past the last bank to add one, run borg --import <banks.lib|bank.save> ... to add the used banks of other files, or add --library <file> to use another library\n", appdir);
+    printf("Hot reload: on Linux banks that other programs change in the library are reloaded while it is open, banks with unsaved edits keep them\n");
+    printf("Undo: press Z to undo and Y to redo, up to %d edits of any bank, a drag or a run of scrolls on one dial is one edit\n", HISTORY_EDITS);
+    printf("Streaming: run borg --stream <bank> <seconds> <file.wav> [u8|s16|f32|flac] to render past %d seconds\n", MAXSAMPLELEN);
     printf("\n");
     printf("BIQUADS are executed from left to right, first BIQUAD 1, then 2, then 3.\n");
     printf("\n");
@@ -1211,6 +5072,12 @@ int main(int argc, char *argv[])
     // set reciprocal sample rate
     reciprocal_sample_rate = 1.f/(float)SAMPLE_RATE;
 
+    // hi-res oscillator transform
+    fftInit(&hires_fft, HIRES_TABLE);
+
+    // fixed-point tables
+    initFixed();
+
     //init audio
     initMonoAudio(SAMPLE_RATE);
 
@@ -1239,10 +5106,18 @@ int main(int argc, char *argv[])
 
     // first render
     stopSample();
+    historySync();
     doSynth(0);
     render(screen);
 
+    // reload banks written by other programs
+    watchStart();
+
+    // index the sound of the banks for F
+    fpStart();
+
     // event loop
+    tick_event = SDL_RegisterEvents(1);
     static Sint32 x, y, rx, ry;
     while(1)
     {
@@ -1257,6 +5132,48 @@ int main(int argc, char *argv[])
                 }
                 break;
 
+                default:
+                {
+                    if(event.type == tick_event)
+                    {
+                        // some user feedback once the files are written
+                        if(exportDone() == 1)
+                        {
+                            exportFinish();
+                            theme_type = 2;
+                            themeon = 1;
+                            if(reload_pending == 1)
+                            {
+                                reload_pending = 0;
+                                if(reloadLibrary() == 1)
+                                    doSynth(0);
+                            }
+                        }
+                        render(screen);
+                        if(exporting == 0 && themeon == 0 && export_timer != 0)
+                        {
+                            SDL_RemoveTimer(export_timer);
+                            export_timer = 0;
+                        }
+                        if(view_timer != 0 && specBusy() == 0)
+                        {
+                            SDL_RemoveTimer(view_timer);
+                            view_timer = 0;
+                        }
+                    }
+                    else if(event.type == reload_event)
+                    {
+                        // the library was written by another program
+                        if(reloadLibrary() == 1)
+                        {
+                            stopSample();
+                            doSynth(0);
+                        }
+                        render(screen);
+                    }
+                }
+                break;
+
                 case SDL_MOUSEMOTION:
                 {
                     x = event.motion.x, y = event.motion.y;
@@ -1269,6 +5186,7 @@ int main(int argc, char *argv[])
                         const Uint32 ni = x-7;
                         const float nv = 1.f-((float)(y-155) * 0.007936508395f);
                         synth[selected_bank].envelope[ni] = nv;
+                        markDirty(selected_bank);
 
                         // really simple but effective smoothing method
                         // otherwise the input code needs to be executed on
@@ -1316,7 +5234,7 @@ int main(int argc, char *argv[])
 
                         // do rotation
                         SDL_GetRelativeMouseState(&rx, &ry);
-                        if(ry != 0){synth[selected_bank].dial_state[selected_dial] -= ((float)(ry))*sense;}
+                        if(ry != 0){synth[selected_bank].dial_state[selected_dial] -= ((float)(ry))*sense; markDirty(selected_bank);}
                         if(dial_neg[selected_dial] == 1)
                         {
                             if(synth[selected_bank].dial_state[selected_dial] >= 1.f)
@@ -1389,20 +5307,131 @@ int main(int argc, char *argv[])
                         doSynth(1);
                         render(screen);
                     }
+                    else if(event.key.keysym.sym == SDLK_b)
+                    {
+                        // cycle the export format, 8-bit, 16-bit, 32-bit float, flac
+                        if(export_format == SAMPLE_U8)
+                            export_format = SAMPLE_S16;
+                        else if(export_format == SAMPLE_S16)
+                            export_format = SAMPLE_F32;
+                        else if(export_format == SAMPLE_F32)
+                            export_format = SAMPLE_FLAC;
+                        else
+                            export_format = SAMPLE_U8;
+                        render(screen);
+                    }
+                    else if(event.key.keysym.sym == SDLK_x)
+                    {
+                        // cycle the export sample rate, render rate, 48 kHz, 96 kHz
+                        if(export_rate == 0)
+                            export_rate = 48000;
+                        else if(export_rate == 48000)
+                            export_rate = 96000;
+                        else
+                            export_rate = 0;
+                        render(screen);
+                    }
+                    else if(event.key.keysym.sym == SDLK_q)
+                    {
+                        // cycle the resampler quality
+                        export_quality = (export_quality + 1) % (RESAMPLE_BEST + 1);
+                        render(screen);
+                    }
+                    else if(event.key.keysym.sym == SDLK_e)
+                    {
+                        // export every used bank in the background, the tick redraws the progress
+                        if(exportAllStart(export_format) > 0 && export_timer == 0)
+                            export_timer = SDL_AddTimer(EXPORT_TICK, exportTick, NULL);
+                        render(screen);
+                    }
+                    else if(event.key.keysym.sym == SDLK_k)
+                    {
+                        // multisample the selected bank over the default key range
+                        if(multiStart(selected_bank, MULTI_ROOT, MULTI_LOW, MULTI_HIGH, MULTI_STEP, export_format) > 0 && export_timer == 0)
+                            export_timer = SDL_AddTimer(EXPORT_TICK, exportTick, NULL);
+                        render(screen);
+                    }
+                    else if((event.key.keysym.sym == SDLK_z || event.key.keysym.sym == SDLK_y) && selected_dial < 0 && envelope_enabled == 0)
+                    {
+                        // undo or redo the last edit, a sound heard before comes from the render cache
+                        const Uint32 b = selected_bank;
+                        if((event.key.keysym.sym == SDLK_z ? historyUndo() : historyRedo()) == 1)
+                        {
+                            if(selected_bank != b)
+                                stopSample();
+                            doSynth(0);
+                            render(screen);
+                        }
+                    }
+                    else if(event.key.keysym.sym == SDLK_a)
+                    {
+                        // cycle the scope panel, oscilloscope, spectrogram, spectrum
+                        view = (view + 1) % 3;
+                        render(screen);
+                    }
+                    else if(event.key.keysym.sym == SDLK_f)
+                    {
+                        // to the bank that sounds most like this one, again for the next most alike
+                        static Uint32 like[FP_K], like_n = 0, like_at = 0;
+                        if(like_n > 0 && selected_bank == like[like_at])
+                            like_at = (like_at + 1) % like_n;
+                        else
+                        {
+                            like_n = fpQuery(selected_bank, FP_K, like);
+                            like_at = 0;
+                        }
+                        if(like_n > 0)
+                        {
+                            stopSample();
+                            selected_bank = like[like_at];
+                            bankLoad(selected_bank);
+                            doSynth(0);
+                            render(screen);
+                        }
+                    }
+                    else if(event.key.keysym.sym == SDLK_i)
+                    {
+                        // toggle linear/hermite envelope interpolation
+                        synth[selected_bank].env_interp ^= 1;
+                        markDirty(selected_bank);
+                        doSynth(0);
+                        render(screen);
+                    }
+                    else if(event.key.keysym.sym == SDLK_h)
+                    {
+                        // toggle the hi-res (IFFT) engine of the hovered oscillator
+                        for(int i = 0; i < 32; i++)
+                        {
+                            if(ui.dial_hover[i] == 1)
+                            {
+                                const Sint32 osc = dialOscillator(i);
+                                const Uint32 rd = osc < 4 ? 16 + osc*4 + 2 : (osc-4)*4 + 2;
+
+                                // keep the current resolution
+                                const float r = synth[selected_bank].dial_state[rd] * dialScale(rd);
+                                synth[selected_bank].hires_state[osc] ^= 1;
+                                synth[selected_bank].dial_state[rd] = r / dialScale(rd);
+                                if(synth[selected_bank].dial_state[rd] > 1.f)
+                                    synth[selected_bank].dial_state[rd] = 1.f;
+                                markDirty(selected_bank);
+
+                                doSynth(0);
+                                render(screen);
+                                break;
+                            }
+                        }
+                    }
                 }
                 break;
 
                 case SDL_MOUSEBUTTONUP:
                 {
-                    static struct ssynth lsyn[256];
-
                     if(envelope_enabled == 1)
                     {
                         SDL_CaptureMouse(SDL_FALSE);
                         envelope_enabled = 0;
                         doSynth(0);
                         render(screen);
-                        memcpy(&lsyn, &synth[selected_bank], sizeof(struct sui));
                     }
                     else if(selected_dial >= 0)
                     {
@@ -1413,15 +5442,13 @@ int main(int argc, char *argv[])
                         selected_dial = -1;
                         doSynth(0);
                         render(screen);
-                        memcpy(&lsyn, &synth[selected_bank], sizeof(struct sui));
                     }
                     else
                     {
-                        if(memcmp(&lsyn, &synth[selected_bank], sizeof(struct sui)) != 0)
+                        if(renderKey(selected_bank) != render_key)
                         {
                             doSynth(0);
                             render(screen);
-                            memcpy(&lsyn, &synth[selected_bank], sizeof(struct sui));
                         }
                     }
                 }
@@ -1429,6 +5456,108 @@ int main(int argc, char *argv[])
 
                 case SDL_MOUSEWHEEL:
                 {
+                    // hold V or W to select the reverb impulse response or its wet mix
+                    const Uint8* keys = SDL_GetKeyboardState(NULL);
+                    if(keys[SDL_SCANCODE_V] == 1)
+                    {
+                        int ir = (int)synth[selected_bank].ir_state + event.wheel.y;
+                        if(ir < 0){ir = 0;}
+                        else if(ir > MAXIMPULSE){ir = MAXIMPULSE;}
+                        synth[selected_bank].ir_state = ir;
+                        markDirty(selected_bank);
+                        doSynth(0);
+                        render(screen);
+                        break;
+                    }
+                    else if(keys[SDL_SCANCODE_W] == 1)
+                    {
+                        synth[selected_bank].ir_mix += ((float)event.wheel.y)*0.01f;
+                        if(synth[selected_bank].ir_mix < 0.f){synth[selected_bank].ir_mix = 0.f;}
+                        else if(synth[selected_bank].ir_mix > 1.f){synth[selected_bank].ir_mix = 1.f;}
+                        markDirty(selected_bank);
+                        doSynth(0);
+                        render(screen);
+                        break;
+                    }
+
+                    // hold U, D or S to set the unison voices, detune or spread of the hovered oscillator
+                    if(keys[SDL_SCANCODE_U] == 1 || keys[SDL_SCANCODE_D] == 1 || keys[SDL_SCANCODE_S] == 1)
+                    {
+                        for(int i = 0; i < 32; i++)
+                        {
+                            if(ui.dial_hover[i] == 1)
+                            {
+                                const Sint32 osc = dialOscillator(i);
+                                if(keys[SDL_SCANCODE_U] == 1)
+                                {
+                                    Sint32 v = synth[selected_bank].unison_state[osc] + event.wheel.y;
+                                    if(v < 0){v = 0;}
+                                    else if(v > MAXUNISON-1){v = MAXUNISON-1;}
+                                    synth[selected_bank].unison_state[osc] = v;
+                                }
+                                else
+                                {
+                                    float* v = &synth[selected_bank].detune_state[osc];
+                                    if(keys[SDL_SCANCODE_S] == 1)
+                                        v = &synth[selected_bank].spread_state[osc];
+                                    *v += ((float)event.wheel.y)*0.01f;
+                                    if(*v < 0.f){*v = 0.f;}
+                                    else if(*v > 1.f){*v = 1.f;}
+                                }
+                                markDirty(selected_bank);
+                                doSynth(0);
+                                render(screen);
+                                break;
+                            }
+                        }
+                        break;
+                    }
+
+                    // hold M, R or T and scroll over a dial to set the depth, rate or type of its modulator
+                    if(keys[SDL_SCANCODE_M] == 1 || keys[SDL_SCANCODE_R] == 1 || keys[SDL_SCANCODE_T] == 1)
+                    {
+                        for(int i = 0; i < 50; i++)
+                        {
+                            if(ui.dial_hover[i] == 1)
+                            {
+                                const Sint32 ms = getModSlot(i, keys[SDL_SCANCODE_M]);
+                                if(ms < 0)
+                                    break;
+
+                                if(keys[SDL_SCANCODE_M] == 1)
+                                {
+                                    float* v = &synth[selected_bank].mod_depth[ms];
+                                    *v += ((float)event.wheel.y)*0.01f;
+                                    if(*v < -1.f){*v = -1.f;}
+                                    else if(*v > 1.f){*v = 1.f;}
+
+                                    // zero depth frees the slot
+                                    if(fabsf(*v) < 0.005f)
+                                        synth[selected_bank].mod_type[ms] = 0;
+                                }
+                                else if(keys[SDL_SCANCODE_R] == 1)
+                                {
+                                    float* v = &synth[selected_bank].mod_rate[ms];
+                                    *v += ((float)event.wheel.y)*0.01f;
+                                    if(*v < 0.f){*v = 0.f;}
+                                    else if(*v > 1.f){*v = 1.f;}
+                                }
+                                else
+                                {
+                                    Sint32 v = synth[selected_bank].mod_type[ms] + event.wheel.y;
+                                    if(v < 1){v = 1;}
+                                    else if(v > 6){v = 6;}
+                                    synth[selected_bank].mod_type[ms] = v;
+                                }
+                                markDirty(selected_bank);
+                                doSynth(0);
+                                render(screen);
+                                break;
+                            }
+                        }
+                        break;
+                    }
+
                     for(int i = 0; i < 50; i++)
                     {
                         if(ui.dial_hover[i] == 1)
@@ -1463,6 +5592,7 @@ int main(int argc, char *argv[])
                             }
 
                             // update
+                            markDirty(selected_bank);
                             doSynth(0);
                             render(screen);
 
@@ -1496,6 +5626,7 @@ int main(int argc, char *argv[])
                                 {
                                     sc=1;
                                     synth[selected_bank].am_state[i] = 0;
+                                    markDirty(selected_bank);
                                     doSynth(0);
                                     render(screen);
                                     break;
@@ -1510,6 +5641,7 @@ int main(int argc, char *argv[])
                                 {
                                     sc=1;
                                     synth[selected_bank].mul_state[i] = 0;
+                                    markDirty(selected_bank);
                                     doSynth(0);
                                     render(screen);
                                     break;
@@ -1524,6 +5656,7 @@ int main(int argc, char *argv[])
                                 {
                                     sc=1;
                                     synth[selected_bank].fm_state[i] = 0;
+                                    markDirty(selected_bank);
                                     doSynth(0);
                                     render(screen);
                                     break;
@@ -1536,6 +5669,7 @@ int main(int argc, char *argv[])
                         {
                             for(int i = 0; i < 466; i++)
                                 synth[selected_bank].envelope[i] = 0.5f;
+                            markDirty(selected_bank);
                             doSynth(0);
                             render(screen);
                             break;
@@ -1565,7 +5699,10 @@ int main(int argc, char *argv[])
                             if(ui.dial_hover[i] == 1)
                             {
                                 if(dial_neg[i] == 1)
+                                {
                                     synth[selected_bank].dial_state[i] *= -1;
+                                    markDirty(selected_bank);
+                                }
                                 wd = 0;
                                 break;
                             }
@@ -1605,48 +5742,44 @@ int main(int argc, char *argv[])
                             else if(ui.export_hover == 1)
                             {
                                 sc=1;
-                                char file[256];
-#ifdef __linux__
-                                sprintf(file, "%s/EXPORTS", getenv("HOME"));
-                                mkdir(file, 0755);
-                                sprintf(file, "%s/Borg_ER-3", file);
-                                mkdir(file, 0755);
-                                sprintf(file, "%s/bank-%d.wav", file, selected_bank);
-                                printf("File written to: %s\n", file);
-#else
-                                sprintf(file, "bank-%d.wav", selected_bank);
-#endif
-                                writeWAV(file);
-
-                                // some user feedback
-                                theme_type = 2;
-                                themeon=1;
-                                while(themeon == 1)
-                                    render(screen);
+                                // rendered and written in the background, the tick drives the feedback
+                                if(exportStart(&selected_bank, 1, export_format) > 0 && export_timer == 0)
+                                    export_timer = SDL_AddTimer(EXPORT_TICK, exportTick, NULL);
                             }
                             else if(ui.load_hover == 1)
                             {
                                 sc=1;
                                 loadState();
+                                historyClear();
                                 doSynth(0);
                             }
                             else if(ui.save_hover == 1)
                             {
                                 sc=1;
                                 saveState();
+                                watchStamp();
+                                historySync();
+                                fpKick();
                             }
                             else if(ui.bankl_hover == 1)
                             {
                                 stopSample();
                                 sc=1;
-                                selected_bank--;
+                                selected_bank = selected_bank == 0 ? store.count-1 : selected_bank-1;
+                                bankLoad(selected_bank);
                                 doSynth(0);
                             }
                             else if(ui.bankr_hover == 1)
                             {
                                 stopSample();
                                 sc=1;
-                                selected_bank++;
+                                // past the last bank a new one is added, unless the last is still blank
+                                if(selected_bank+1 < store.count || (exporting == 0 && bankUsed(selected_bank) == 1 && addBank() == 1))
+                                    selected_bank++;
+                                else
+                                    selected_bank = 0;
+                                watchStamp();
+                                bankLoad(selected_bank);
                                 doSynth(0);
                             }
                             else if(ui.secl_hover == 1)
@@ -1655,6 +5788,7 @@ int main(int argc, char *argv[])
                                 synth[selected_bank].seclen--;
                                 if(synth[selected_bank].seclen == 0)
                                     synth[selected_bank].seclen = MAXSAMPLELEN;
+                                markDirty(selected_bank);
                                 doSynth(0);
                                 stopSample();
                             }
@@ -1664,6 +5798,7 @@ int main(int argc, char *argv[])
                                 synth[selected_bank].seclen++;
                                 if(synth[selected_bank].seclen > MAXSAMPLELEN)
                                     synth[selected_bank].seclen = 1;
+                                markDirty(selected_bank);
                                 doSynth(0);
                                 stopSample();
                             }
@@ -1679,6 +5814,7 @@ int main(int argc, char *argv[])
                                     synth[selected_bank].am_state[i]++;
                                     if(synth[selected_bank].am_state[i] >= 4)
                                         synth[selected_bank].am_state[i] = 0;
+                                    markDirty(selected_bank);
                                     doSynth(0);
                                     render(screen);
                                     break;
@@ -1696,6 +5832,7 @@ int main(int argc, char *argv[])
                                     synth[selected_bank].mul_state[i]++;
                                     if(synth[selected_bank].mul_state[i] >= 4)
                                         synth[selected_bank].mul_state[i] = 0;
+                                    markDirty(selected_bank);
                                     doSynth(0);
                                     render(screen);
                                     break;
@@ -1713,6 +5850,7 @@ int main(int argc, char *argv[])
                                     synth[selected_bank].fm_state[i]++;
                                     if(synth[selected_bank].fm_state[i] >= 4)
                                         synth[selected_bank].fm_state[i] = 0;
+                                    markDirty(selected_bank);
                                     doSynth(0);
                                     render(screen);
                                     break;
@@ -1739,6 +5877,8 @@ int main(int argc, char *argv[])
                 
                 case SDL_QUIT:
                 {
+                    exportFinish();
+                    fpStop();
                     saveState();
                     SDL_FreeSurface(bb);
                     SDL_FreeSurface(s_bg);
@@ -1752,11 +5892,16 @@ int main(int argc, char *argv[])
                     drawText(NULL, "*K", 0, 0, 0);
                     SDL_DestroyWindow(window);
                     SDL_CloseAudio();
+                    arenaFree(&render_arena);
                     SDL_Quit();
                     exit(0);
                 }
                 break;
             }
+
+            // edits are kept once the gesture that made them is over
+            if(selected_dial < 0 && envelope_enabled == 0)
+                historyCommit();
         }
     }
 
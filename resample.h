@@ -0,0 +1,204 @@
+/*
+    Borg ER-3
+
+    Polyphase windowed-sinc sample rate converter for the
+    export path, the engine renders at SAMPLE_RATE and files
+    can be written at another rate.
+
+    The rates are reduced to up/down, output sample k sits
+    k*down/up input samples in, so it needs one of up fixed
+    phases of a Kaiser windowed sinc. The phases are worked
+    out once per file and each output is then a single dot
+    product over taps input samples, 8 taps per multiply.
+
+    Input is pushed in blocks of up to RESAMPLE_BLOCK and
+    only taps samples of history are kept between them, so
+    renders of any length can be streamed through it.
+*/
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <SDL2/SDL.h>
+#include <math.h>
+#include "arena.h"
+#include "vec.h"
+
+#define RESAMPLE_FAST 0
+#define RESAMPLE_GOOD 1
+#define RESAMPLE_BEST 2
+
+#define RESAMPLE_BLOCK      4096 // input samples per resampleRun
+#define RESAMPLE_MAX_TAPS   128
+#define RESAMPLE_MAX_PHASES 512
+#define RESAMPLE_MAX_RATIO  4    // output rate at most 4x the input rate
+#define RESAMPLE_OUT        ((RESAMPLE_BLOCK + RESAMPLE_MAX_TAPS) * RESAMPLE_MAX_RATIO) // outputs per call at most
+#define RESAMPLE_BUFFER     ((RESAMPLE_MAX_PHASES*RESAMPLE_MAX_TAPS + RESAMPLE_BLOCK + RESAMPLE_MAX_TAPS*2) * sizeof(float) + ARENA_ALIGN*2)
+
+// presets, taps per phase, Kaiser beta (stopband) and cutoff against the lower nyquist
+const char*  resample_names[]  = {"fast", "good", "best"};
+const Uint32 resample_taps[]   = {16, 48, 128};
+const double resample_beta[]   = {4.5, 7.9, 10.6}; // about 50, 80 and 105 dB
+const double resample_cutoff[] = {0.82, 0.895, 0.947};
+
+struct sresample
+{
+    Uint32 up, down;    // output/input rate ratio in lowest terms
+    Uint32 taps;        // per phase, a multiple of 8
+    float* bank;        // up*taps, phase f at bank[f*taps]
+    float* buf;         // taps of history and the block being run
+    Uint32 fill;
+    Uint64 pos;         // next output, in 1/up input samples from buf[0]
+    Uint64 in, out;     // samples taken and given
+    Uint64 ticks;       // performance counter spent converting
+};
+
+// state
+int resampleInit(struct sresample* r, struct sarena* arena, Uint32 from, Uint32 to, Uint32 quality); // -1 for an unsupported ratio
+
+// run
+Uint32 resampleRun(struct sresample* r, const float* in, Uint32 n, float* out); // n <= RESAMPLE_BLOCK, out holds RESAMPLE_OUT
+Uint32 resampleFlush(struct sresample* r, float* out); // the filter tail, out holds RESAMPLE_OUT
+float  resampleAt(const struct sresample* r, const float* in, Uint32 len, Uint64 k); // output k of all of in, as resampleRun gives it
+float  resampleDot(const float* h, const float* x, Uint32 n);
+
+// window
+double besselI0(double x);
+
+/*
+    functions bodies
+*/
+
+double besselI0(double x)
+{
+    // power series, converges quickly for the betas used here
+    double s = 1.0, t = 1.0;
+    for(int k = 1; k < 32; k++)
+    {
+        t *= (x / (2.0 * k)) * (x / (2.0 * k));
+        s += t;
+        if(t < s * 1e-12)
+            break;
+    }
+    return s;
+}
+
+int resampleInit(struct sresample* r, struct sarena* arena, Uint32 from, Uint32 to, Uint32 quality)
+{
+    memset(r, 0x00, sizeof(struct sresample));
+    Uint32 a = from, b = to;
+    while(b != 0)
+    {
+        const Uint32 t = a % b;
+        a = b;
+        b = t;
+    }
+    if(from == 0 || to == 0 || quality > RESAMPLE_BEST)
+        return -1;
+    r->up = to / a;
+    r->down = from / a;
+    r->taps = resample_taps[quality];
+    if(r->up > RESAMPLE_MAX_PHASES || r->up > r->down * RESAMPLE_MAX_RATIO || r->down > r->up * r->taps)
+        return -1;
+    r->bank = arenaAlloc(arena, r->up * r->taps * sizeof(float));
+    r->buf = arenaAlloc(arena, (RESAMPLE_BLOCK + r->taps*2) * sizeof(float));
+    if(r->bank == NULL || r->buf == NULL)
+        return -1;
+
+    // the cutoff is below the lower of the two nyquists
+    const double fc = resample_cutoff[quality] * (r->up < r->down ? (double)r->up / (double)r->down : 1.0);
+    const double beta = resample_beta[quality];
+    const double half = r->taps / 2;
+    const double i0 = besselI0(beta);
+    for(Uint32 f = 0; f < r->up; f++)
+    {
+        // tap j is input buf[b+j] of an output at b + half-1 + f/up
+        float* h = &r->bank[f * r->taps];
+        double sum = 0.0;
+        for(Uint32 j = 0; j < r->taps; j++)
+        {
+            const double d = (double)j - (half - 1.0) - (double)f / (double)r->up;
+            const double x = d / half;
+            const double w = x * x < 1.0 ? besselI0(beta * sqrt(1.0 - x*x)) / i0 : 0.0;
+            const double s = d == 0.0 ? 1.0 : sin(3.141592653589793 * fc * d) / (3.141592653589793 * fc * d);
+            h[j] = fc * s * w;
+            sum += h[j];
+        }
+
+        // unity gain on every phase, no ripple at dc
+        for(Uint32 j = 0; j < r->taps; j++)
+            h[j] /= sum;
+    }
+
+    // the first output is centred on the first input
+    r->fill = half - 1;
+    memset(r->buf, 0x00, r->fill * sizeof(float));
+    return 1;
+}
+
+float resampleDot(const float* h, const float* x, Uint32 n)
+{
+    v8f acc = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+    for(Uint32 i = 0; i < n; i += 8)
+    {
+        v8f a, b;
+        memcpy(&a, &h[i], sizeof(v8f));
+        memcpy(&b, &x[i], sizeof(v8f));
+        acc += a * b;
+    }
+    return (acc[0] + acc[4]) + (acc[1] + acc[5]) + (acc[2] + acc[6]) + (acc[3] + acc[7]);
+}
+
+Uint32 resampleRun(struct sresample* r, const float* in, Uint32 n, float* out)
+{
+    const Uint64 t0 = SDL_GetPerformanceCounter();
+
+    // drop the history no output needs anymore
+    const Uint32 s = r->pos / r->up;
+    if(s > 0)
+    {
+        memmove(r->buf, &r->buf[s], (r->fill - s) * sizeof(float));
+        r->fill -= s;
+        r->pos -= (Uint64)s * r->up;
+    }
+    memcpy(&r->buf[r->fill], in, n * sizeof(float));
+    r->fill += n;
+    r->in += n;
+
+    Uint32 k = 0;
+    Uint32 b = r->pos / r->up;
+    while(b + r->taps <= r->fill)
+    {
+        out[k++] = resampleDot(&r->bank[(r->pos % r->up) * r->taps], &r->buf[b], r->taps);
+        r->pos += r->down;
+        b = r->pos / r->up;
+    }
+    r->out += k;
+    r->ticks += SDL_GetPerformanceCounter() - t0;
+    return k;
+}
+
+float resampleAt(const struct sresample* r, const float* in, Uint32 len, Uint64 k)
+{
+    // the same taps and phase as the stream, zeros before and past in
+    float x[RESAMPLE_MAX_TAPS];
+    const Sint64 b = (Sint64)(k * r->down / r->up) - (Sint64)(r->taps/2 - 1);
+    for(Uint32 j = 0; j < r->taps; j++)
+        x[j] = b + j >= 0 && b + j < len ? in[b + j] : 0.f;
+    return resampleDot(&r->bank[(k * r->down % r->up) * r->taps], x, r->taps);
+}
+
+Uint32 resampleFlush(struct sresample* r, float* out)
+{
+    // run zeros through the filter, then trim to in*up/down outputs
+    const float zero[RESAMPLE_MAX_TAPS] = {0.f};
+    const Uint64 in = r->in;
+    const Uint64 want = (in * r->up + r->down - 1) / r->down;
+    const Uint64 before = r->out;
+    Uint32 k = resampleRun(r, zero, r->taps, out);
+    r->in = in;
+    k = want > before ? (want - before < k ? want - before : k) : 0;
+    r->out = before + k;
+    return k;
+}
+
+#endif
@@ -0,0 +1,709 @@
+/*
+    Borg ER-3
+
+    Bank library, a file of fixed size records that is mapped
+    instead of read, so opening it costs the same for 256 banks
+    as for 10,000 and a bank is only paged in when it is used.
+
+    The file is a header, an index of one flags word per record
+    and the records back to back from a page boundary. What is in
+    a record is up to its owner, the header keeps the format it
+    was given so older files can be told apart. The index
+    has room reserved past the last record, new records are
+    written at the end of the file and the header is rewritten
+    last, a crash in between leaves the old count. Once the room
+    runs out the file is copied into one with a larger index.
+
+    The mapping is private, edits stay in memory until a save.
+    A save writes the edited records to a journal first, which
+    is synced, then writes them in place and removes it. A
+    journal left by a crash is replayed when the file is opened
+    and a torn one fails its checksum and is dropped.
+
+    Other writers have to replace the file by a rename, as a save
+    that grows the index does, the mapping keeps the old one. A
+    file truncated in place faults the pages past its new end, so
+    storeIntact is asked before the mapping is touched.
+
+    Off Linux the file is read whole into memory and every save
+    writes a new file that replaces the old one.
+*/
+#ifndef STORE_H
+#define STORE_H
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+
+#ifdef __linux__
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#define STORE_VERSION 1
+#define STORE_HEAD    64   // bytes of struct sstorehead
+#define STORE_PAGE    4096 // the records start on a page
+#define STORE_STEP    1024 // index entries are reserved in steps of
+#define STORE_USED    1    // index flag, set by the owner of the records
+#define STORE_JOURNAL 16   // "BORGJNL2", record size, count
+
+struct sstorehead
+{
+    char magic[8];      // "BORGLIB1"
+    Uint32 version;
+    Uint32 record;      // bytes per record
+    Uint32 count;       // records in the file
+    Uint32 capacity;    // index entries reserved
+    Uint64 index;       // offset of the index
+    Uint64 records;     // offset of the first record
+    Uint32 format;      // of the records, chosen by their owner
+    Uint8 pad[20];
+};
+
+struct sstore
+{
+    char path[256];     // "" for a store that is never saved
+    Uint32 format;
+    Uint32 record;
+    Uint32 count;
+    Uint32 capacity;
+    Uint64 index_at;    // file offsets
+    Uint64 records_at;
+    Uint32* index;      // flags per record
+    Uint8* base;        // record 0
+    Uint8* dirty;       // per record, edited since the last save
+    Uint8* map;         // the file mapping, NULL when the records are in memory
+    size_t size;        // of map
+    Uint8 full;         // the next save writes the whole file
+    Uint32 recovered;   // records replayed from a journal when opened
+    int fd;
+};
+
+// file
+int  storeCreate(const char* path, Uint32 format, Uint32 record, const void* records, const Uint32* flags, Uint32 count);
+int  storeOpen(struct sstore* s, const char* path, Uint32 format, Uint32 record); // -1 when missing or not a library of this format
+void storeMemory(struct sstore* s, Uint32 format, Uint32 record, const void* records, Uint32 count); // never saved
+void storeClose(struct sstore* s);
+int  storeIntact(const struct sstore* s); // 0 once the file was cut short under the mapping
+
+// records
+int  storeAppend(struct sstore* s, const void* records, const Uint32* flags, Uint32 n); // may move base
+int  storeSave(struct sstore* s);   // the dirty records with their index flags
+void storeRevert(struct sstore* s); // the dirty records and their index flags as they are in the file
+Uint32 storeDirty(const struct sstore* s);
+
+// internal
+void   storeHead(struct sstorehead* h, Uint32 format, Uint32 record, Uint32 count, Uint32 capacity);
+int    storeCheck(const struct sstorehead* h, Uint32 format, Uint32 record);
+Uint32 storeCapacity(Uint32 count);
+int    storeWrite(const char* path, const struct sstorehead* h, const Uint32* index, const void* records);
+Uint64 storeSum(const Uint8* p, size_t n);
+#ifdef __linux__
+int  pwriteAll(int fd, const void* p, size_t n, off_t off);
+int  storeCopy(int from, off_t a, int to, off_t b, size_t n);
+int  storeMap(struct sstore* s);
+void storeSyncDir(const char* path);
+int  storeApply(struct sstore* s, const Uint8* j, Uint32 count);
+void storeReplay(struct sstore* s);
+int  storeJournal(struct sstore* s);
+int  storeGrow(struct sstore* s, const void* records, const Uint32* flags, Uint32 n);
+#endif
+
+/*
+    functions bodies
+*/
+
+Uint32 storeCapacity(Uint32 count)
+{
+    return (count / STORE_STEP + 1) * STORE_STEP;
+}
+
+void storeHead(struct sstorehead* h, Uint32 format, Uint32 record, Uint32 count, Uint32 capacity)
+{
+    memset(h, 0x00, sizeof(struct sstorehead));
+    memcpy(h->magic, "BORGLIB1", 8);
+    h->version = STORE_VERSION;
+    h->format = format;
+    h->record = record;
+    h->count = count;
+    h->capacity = capacity;
+    h->index = STORE_HEAD;
+    h->records = (STORE_HEAD + (Uint64)capacity*4 + STORE_PAGE-1) / STORE_PAGE * STORE_PAGE;
+}
+
+int storeCheck(const struct sstorehead* h, Uint32 format, Uint32 record)
+{
+    return memcmp(h->magic, "BORGLIB1", 8) == 0 && h->version == STORE_VERSION && h->format == format && h->record == record &&
+           h->count <= h->capacity && h->index >= STORE_HEAD && h->index + (Uint64)h->capacity*4 <= h->records &&
+           h->records % STORE_PAGE == 0;
+}
+
+Uint64 storeSum(const Uint8* p, size_t n)
+{
+    // FNV-1a
+    Uint64 h = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < n; i++)
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+int storeWrite(const char* path, const struct sstorehead* h, const Uint32* index, const void* records)
+{
+    // a new file beside the old one, renamed over it once it is complete
+    char tmp[272];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "wb");
+    if(f == NULL)
+        return -1;
+    int r = fwrite(h, sizeof(struct sstorehead), 1, f) == 1 ? 1 : -1;
+    if(r == 1 && h->count > 0 && fwrite(index, 4, h->count, f) != h->count)
+        r = -1;
+    for(Uint64 p = h->index + (Uint64)h->count*4; p < h->records && r == 1; p++)
+        if(fputc(0x00, f) == EOF)
+            r = -1;
+    if(r == 1 && h->count > 0 && fwrite(records, h->record, h->count, f) != h->count)
+        r = -1;
+    if(fflush(f) != 0)
+        r = -1;
+#ifdef __linux__
+    if(r == 1 && fsync(fileno(f)) != 0)
+        r = -1;
+#endif
+    if(fclose(f) != 0)
+        r = -1;
+    if(r == 1)
+    {
+#ifndef __linux__
+        remove(path); // rename does not replace
+#endif
+        if(rename(tmp, path) != 0)
+            r = -1;
+    }
+    if(r < 0)
+        remove(tmp);
+#ifdef __linux__
+    else
+        storeSyncDir(path);
+#endif
+    return r;
+}
+
+int storeCreate(const char* path, Uint32 format, Uint32 record, const void* records, const Uint32* flags, Uint32 count)
+{
+    struct sstorehead h;
+    storeHead(&h, format, record, count, storeCapacity(count));
+    Uint32* index = calloc(count + 1, 4);
+    if(index == NULL)
+        return -1;
+    if(flags != NULL)
+        memcpy(index, flags, count*4);
+    const int r = storeWrite(path, &h, index, records);
+    free(index);
+    return r;
+}
+
+void storeMemory(struct sstore* s, Uint32 format, Uint32 record, const void* records, Uint32 count)
+{
+    memset(s, 0x00, sizeof(struct sstore));
+    s->fd = -1;
+    s->format = format;
+    s->record = record;
+    s->count = count;
+    s->capacity = count;
+    s->index = calloc(count, 4);
+    s->dirty = calloc(count, 1);
+    s->base = malloc((size_t)count * record);
+    if(s->index == NULL || s->dirty == NULL || s->base == NULL)
+    {
+        printf("Out of memory for %u banks.\n", count);
+        exit(1);
+    }
+    memcpy(s->base, records, (size_t)count * record);
+}
+
+int storeOpen(struct sstore* s, const char* path, Uint32 format, Uint32 record)
+{
+    memset(s, 0x00, sizeof(struct sstore));
+    s->fd = -1;
+    snprintf(s->path, sizeof(s->path), "%s", path);
+    s->format = format;
+    s->record = record;
+    struct sstorehead h;
+#ifdef __linux__
+    s->fd = open(path, O_RDWR);
+    if(s->fd < 0)
+        return -1;
+    if(pread(s->fd, &h, sizeof(struct sstorehead), 0) != sizeof(struct sstorehead) || storeCheck(&h, format, record) == 0)
+    {
+        close(s->fd);
+        s->fd = -1;
+        return -1;
+    }
+#else
+    FILE* f = fopen(path, "rb");
+    if(f == NULL)
+        return -1;
+    if(fread(&h, sizeof(struct sstorehead), 1, f) != 1 || storeCheck(&h, format, record) == 0)
+    {
+        fclose(f);
+        return -1;
+    }
+#endif
+    s->count = h.count;
+    s->capacity = h.capacity;
+    s->index_at = h.index;
+    s->records_at = h.records;
+    s->dirty = calloc(s->count + 1, 1);
+#ifdef __linux__
+    if(s->dirty == NULL)
+    {
+        close(s->fd);
+        s->fd = -1;
+        return -1;
+    }
+    storeReplay(s);
+    if(storeMap(s) < 0)
+    {
+        close(s->fd);
+        s->fd = -1;
+        free(s->dirty);
+        return -1;
+    }
+#else
+    s->index = malloc((size_t)s->count*4 + 4);
+    s->base = malloc((size_t)s->count * record + 1);
+    int r = s->index != NULL && s->base != NULL && s->dirty != NULL;
+    if(r == 1 && s->count > 0)
+    {
+        r = fseek(f, h.index, SEEK_SET) == 0 && fread(s->index, 4, s->count, f) == s->count &&
+            fseek(f, h.records, SEEK_SET) == 0 && fread(s->base, record, s->count, f) == s->count;
+    }
+    fclose(f);
+    if(r == 0)
+    {
+        free(s->index);
+        free(s->base);
+        free(s->dirty);
+        return -1;
+    }
+#endif
+    return 1;
+}
+
+void storeClose(struct sstore* s)
+{
+#ifdef __linux__
+    if(s->map != NULL)
+        munmap(s->map, s->size);
+    if(s->fd >= 0)
+        close(s->fd);
+#endif
+    if(s->map == NULL)
+    {
+        free(s->index);
+        free(s->base);
+    }
+    free(s->dirty);
+    memset(s, 0x00, sizeof(struct sstore));
+    s->fd = -1;
+}
+
+int storeIntact(const struct sstore* s)
+{
+#ifdef __linux__
+    struct stat st;
+    if(s->map != NULL && (fstat(s->fd, &st) != 0 || (size_t)st.st_size < s->size))
+        return 0;
+#endif
+    return 1;
+}
+
+Uint32 storeDirty(const struct sstore* s)
+{
+    Uint32 n = 0;
+    for(Uint32 i = 0; i < s->count; i++)
+        n += s->dirty[i];
+    return n;
+}
+
+#ifdef __linux__
+int pwriteAll(int fd, const void* p, size_t n, off_t off)
+{
+    while(n > 0)
+    {
+        const ssize_t w = pwrite(fd, p, n, off);
+        if(w <= 0)
+            return -1;
+        p = (const Uint8*)p + w;
+        n -= w;
+        off += w;
+    }
+    return 1;
+}
+
+int storeCopy(int from, off_t a, int to, off_t b, size_t n)
+{
+    static Uint8 buf[65536];
+    while(n > 0)
+    {
+        const size_t c = n < sizeof(buf) ? n : sizeof(buf);
+        if(pread(from, buf, c, a) != (ssize_t)c || pwriteAll(to, buf, c, b) < 0)
+            return -1;
+        a += c;
+        b += c;
+        n -= c;
+    }
+    return 1;
+}
+
+void storeSyncDir(const char* path)
+{
+    // the directory entry of a new or renamed file
+    char dir[272];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char* slash = strrchr(dir, '/');
+    if(slash == NULL)
+        snprintf(dir, sizeof(dir), ".");
+    else
+        slash[1] = 0x00;
+    const int fd = open(dir, O_RDONLY);
+    if(fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+int storeMap(struct sstore* s)
+{
+    // nothing is read here, the pages of a record are faulted in when it is touched
+    struct stat st;
+    const size_t size = s->records_at + (size_t)s->count * s->record;
+    if(fstat(s->fd, &st) != 0 || (size_t)st.st_size < size)
+        return -1;
+    Uint8* map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, s->fd, 0);
+    if(map == MAP_FAILED)
+        return -1;
+    madvise(map + s->records_at, size - s->records_at, MADV_RANDOM); // no readahead into the neighbouring banks
+
+    // edits not saved yet only exist in the old mapping
+    if(s->map != NULL)
+    {
+        for(Uint32 i = 0; i < s->count; i++)
+            if(s->dirty[i] == 1)
+                memcpy(map + s->records_at + (size_t)i * s->record, s->base + (size_t)i * s->record, s->record);
+        munmap(s->map, s->size);
+    }
+    s->map = map;
+    s->size = size;
+    s->index = (Uint32*)(map + s->index_at);
+    s->base = map + s->records_at;
+    return 1;
+}
+
+int storeApply(struct sstore* s, const Uint8* j, Uint32 count)
+{
+    // the records of a checked journal and their flags at their offsets
+    const size_t rec = s->record;
+    int r = 1;
+    for(Uint32 k = 0; k < count && r == 1; k++)
+    {
+        const Uint8* e = j + STORE_JOURNAL + k*(8+rec);
+        Uint32 i;
+        memcpy(&i, e, 4);
+        r = pwriteAll(s->fd, e+8, rec, s->records_at + (off_t)i * rec);
+        if(r == 1)
+            r = pwriteAll(s->fd, e+4, 4, s->index_at + (off_t)i * 4);
+    }
+    if(r == 1 && fsync(s->fd) != 0)
+        r = -1;
+    return r;
+}
+
+void storeReplay(struct sstore* s)
+{
+    // a complete journal is applied again, a torn one never reached the file
+    char jfile[272];
+    snprintf(jfile, sizeof(jfile), "%s.journal", s->path);
+    FILE* f = fopen(jfile, "rb");
+    if(f == NULL)
+        return;
+    fseek(f, 0, SEEK_END);
+    const long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    const size_t rec = s->record;
+    Uint8* j = len >= STORE_JOURNAL + 8 ? malloc(len) : NULL;
+    int ok = j != NULL && fread(j, len, 1, f) == 1;
+    fclose(f);
+
+    Uint32 r32 = 0, count = 0;
+    if(ok == 1)
+    {
+        memcpy(&r32, j+8, 4);
+        memcpy(&count, j+12, 4);
+        ok = memcmp(j, "BORGJNL2", 8) == 0 && r32 == rec && count <= s->count && (size_t)len == STORE_JOURNAL + count*(8+rec) + 8;
+    }
+    if(ok == 1)
+    {
+        Uint64 sum;
+        memcpy(&sum, j + len - 8, 8);
+        ok = sum == storeSum(j, len - 8);
+        for(Uint32 k = 0; k < count && ok == 1; k++)
+        {
+            Uint32 i;
+            memcpy(&i, j + STORE_JOURNAL + k*(8+rec), 4);
+            ok = i < s->count;
+        }
+    }
+    if(ok == 1)
+    {
+        if(storeApply(s, j, count) == 1)
+            s->recovered = count;
+        else
+            ok = -1; // kept for the next open
+    }
+    if(ok != -1)
+        unlink(jfile);
+    free(j);
+}
+
+int storeJournal(struct sstore* s)
+{
+    char jfile[272];
+    snprintf(jfile, sizeof(jfile), "%s.journal", s->path);
+    const size_t rec = s->record;
+    const Uint32 count = storeDirty(s);
+    const size_t len = STORE_JOURNAL + count*(8+rec) + 8;
+    Uint8* j = malloc(len);
+    if(j == NULL)
+        return -1;
+
+    const Uint32 r32 = rec;
+    memcpy(j, "BORGJNL2", 8);
+    memcpy(j+8, &r32, 4);
+    memcpy(j+12, &count, 4);
+    size_t p = STORE_JOURNAL;
+    for(Uint32 i = 0; i < s->count; i++)
+    {
+        if(s->dirty[i] == 0)
+            continue;
+        memcpy(j+p, &i, 4);
+        memcpy(j+p+4, &s->index[i], 4);
+        memcpy(j+p+8, s->base + (size_t)i * rec, rec);
+        p += 8+rec;
+    }
+    const Uint64 sum = storeSum(j, p);
+    memcpy(j+p, &sum, 8);
+
+    // journal, then the records, then the journal goes
+    int r = -1;
+    const int fd = open(jfile, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if(fd >= 0)
+    {
+        r = pwriteAll(fd, j, len, 0);
+        if(r == 1 && fsync(fd) != 0)
+            r = -1;
+        if(close(fd) != 0)
+            r = -1;
+    }
+    storeSyncDir(jfile);
+    if(r == 1)
+        r = storeApply(s, j, count);
+    if(r == 1)
+        unlink(jfile);
+    free(j);
+    return r;
+}
+
+int storeGrow(struct sstore* s, const void* records, const Uint32* flags, Uint32 n)
+{
+    const size_t rec = s->record;
+    Uint32* index = calloc(n, 4);
+    if(index == NULL)
+        return -1;
+    if(flags != NULL)
+        memcpy(index, flags, n*4);
+
+    struct sstorehead h;
+    int r = 1;
+    if(s->count + n <= s->capacity)
+    {
+        // past the last record, then the header that counts them
+        storeHead(&h, s->format, rec, s->count + n, s->capacity);
+        h.index = s->index_at;
+        h.records = s->records_at;
+        r = pwriteAll(s->fd, records, n*rec, h.records + (off_t)s->count * rec);
+        if(r == 1)
+            r = pwriteAll(s->fd, index, n*4, h.index + (off_t)s->count * 4);
+        if(r == 1 && fsync(s->fd) != 0)
+            r = -1;
+        if(r == 1)
+            r = pwriteAll(s->fd, &h, sizeof(struct sstorehead), 0);
+        if(r == 1 && fsync(s->fd) != 0)
+            r = -1;
+    }
+    else
+    {
+        // a copy with a larger index, the records as they are in the file and not as edited
+        char tmp[272];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", s->path);
+        storeHead(&h, s->format, rec, s->count + n, storeCapacity(s->count + n));
+        const int fd = open(tmp, O_RDWR|O_CREAT|O_TRUNC, 0644);
+        r = fd >= 0 ? 1 : -1;
+        if(r == 1)
+            r = pwriteAll(fd, &h, sizeof(struct sstorehead), 0);
+        if(r == 1)
+            r = storeCopy(s->fd, s->index_at, fd, h.index, (size_t)s->count * 4);
+        if(r == 1)
+            r = pwriteAll(fd, index, n*4, h.index + (off_t)s->count * 4);
+        if(r == 1)
+            r = storeCopy(s->fd, s->records_at, fd, h.records, (size_t)s->count * rec);
+        if(r == 1)
+            r = pwriteAll(fd, records, n*rec, h.records + (off_t)s->count * rec);
+        if(r == 1 && fsync(fd) != 0)
+            r = -1;
+        if(r == 1 && rename(tmp, s->path) != 0)
+            r = -1;
+        if(r == 1)
+        {
+            storeSyncDir(s->path);
+            close(s->fd);
+            s->fd = fd;
+        }
+        else
+        {
+            if(fd >= 0)
+                close(fd);
+            unlink(tmp);
+        }
+    }
+    free(index);
+    if(r < 0)
+        return -1;
+
+    Uint8* dirty = realloc(s->dirty, s->count + n + 1);
+    if(dirty == NULL)
+        return -1;
+    memset(dirty + s->count, 0x00, n + 1);
+    s->dirty = dirty;
+    const Uint32 count = s->count; // the old mapping covers these
+    s->count = count + n;
+    s->capacity = h.capacity;
+    s->index_at = h.index;
+    s->records_at = h.records;
+    if(storeMap(s) < 0)
+    {
+        s->count = count;
+        return -1;
+    }
+    return 1;
+}
+#endif
+
+int storeAppend(struct sstore* s, const void* records, const Uint32* flags, Uint32 n)
+{
+    if(n == 0)
+        return 1;
+#ifdef __linux__
+    if(s->map != NULL)
+        return storeGrow(s, records, flags, n);
+#endif
+    // in memory, the file is written whole by the next save
+    const size_t rec = s->record;
+    Uint32* index = realloc(s->index, ((size_t)s->count + n) * 4);
+    if(index != NULL)
+        s->index = index;
+    Uint8* base = realloc(s->base, ((size_t)s->count + n) * rec);
+    if(base != NULL)
+        s->base = base;
+    Uint8* dirty = realloc(s->dirty, s->count + n + 1);
+    if(dirty != NULL)
+        s->dirty = dirty;
+    if(index == NULL || base == NULL || dirty == NULL)
+        return -1;
+    memcpy(s->base + (size_t)s->count * rec, records, n * rec);
+    if(flags != NULL)
+        memcpy(s->index + s->count, flags, n*4);
+    else
+        memset(s->index + s->count, 0x00, n*4);
+    memset(s->dirty + s->count, 0x00, n + 1);
+    s->count += n;
+    s->capacity = s->count;
+    s->full = 1;
+    return 1;
+}
+
+int storeSave(struct sstore* s)
+{
+    if(s->path[0] == 0x00)
+        return -1;
+    if(storeDirty(s) == 0 && s->full == 0)
+        return 1;
+    if(storeIntact(s) == 0)
+        return -1;
+    int r = -1;
+#ifdef __linux__
+    if(s->map != NULL)
+        r = storeJournal(s);
+    else
+#endif
+    {
+        struct sstorehead h;
+        storeHead(&h, s->format, s->record, s->count, storeCapacity(s->count));
+        r = storeWrite(s->path, &h, s->index, s->base);
+        if(r == 1)
+        {
+            // where storeRevert reads them back from
+            s->index_at = h.index;
+            s->records_at = h.records;
+        }
+    }
+    if(r == 1)
+    {
+        memset(s->dirty, 0x00, s->count);
+        s->full = 0;
+    }
+    return r;
+}
+
+void storeRevert(struct sstore* s)
+{
+    // the dirty records are read back with their flags, a failed save sets those too
+    const size_t rec = s->record;
+    Uint32 flags;
+#ifdef __linux__
+    if(s->map != NULL)
+    {
+        if(storeIntact(s) == 0)
+            return; // the reload of the new file puts them back
+        for(Uint32 i = 0; i < s->count; i++)
+        {
+            if(s->dirty[i] == 1 && pread(s->fd, &flags, 4, s->index_at + (off_t)i * 4) == 4 &&
+               pread(s->fd, s->base + (size_t)i * rec, rec, s->records_at + (off_t)i * rec) == (ssize_t)rec)
+            {
+                s->index[i] = flags;
+                s->dirty[i] = 0;
+            }
+        }
+        return;
+    }
+#endif
+    if(s->path[0] == 0x00 || s->full == 1)
+        return; // records not in the file yet are kept
+    FILE* f = fopen(s->path, "rb");
+    if(f == NULL)
+        return;
+    for(Uint32 i = 0; i < s->count; i++)
+    {
+        if(s->dirty[i] == 1 && fseek(f, s->index_at + (long)i * 4, SEEK_SET) == 0 && fread(&flags, 4, 1, f) == 1 &&
+           fseek(f, s->records_at + (long)i * rec, SEEK_SET) == 0 && fread(s->base + (size_t)i * rec, rec, 1, f) == 1)
+        {
+            s->index[i] = flags;
+            s->dirty[i] = 0;
+        }
+    }
+    fclose(f);
+}
+
+#endif
@@ -17,9 +17,30 @@
 
 #include <SDL2/SDL.h>
 #include <math.h>
+#include "arena.h"
+#include "vec.h"
+#include "flac.h"
+#include "resample.h"
+
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
 
 #define USE_RECIPROCAL_TABLES
 
+// the lane helpers take their vectors by pointer and are always inlined, a v8f passed by value
+// changes ABI with and without AVX, the v8f they return never crosses a real call so gcc's
+// note on it is silenced
+#define V8_INLINE static inline __attribute__ ((always_inline))
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// sample formats of the audio device and exported files
+#define SAMPLE_S8  0
+#define SAMPLE_U8  1
+#define SAMPLE_S16 2
+#define SAMPLE_F32 3
+#define SAMPLE_FLAC 4 // exported files only, 16-bit
+
 // generators
 float getSlantSine(float phase, float resolution);
 float getSquare(float phase, float resolution);
@@ -29,17 +50,78 @@ float getImpulse(float phase, float resolution);
 float getViolin(float phase, float resolution);
 float aliased_sin(float theta);
 
+// unison generators (one phase per lane)
+V8_INLINE v8f getSlantSine8(const v8f* phase, float resolution);
+V8_INLINE v8f getSquare8(const v8f* phase, float resolution);
+V8_INLINE v8f getSawtooth8(const v8f* phase, float resolution);
+V8_INLINE v8f getTriangle8(const v8f* phase, float resolution);
+V8_INLINE v8f getBipulse8(const v8f* phase, float resolution);
+V8_INLINE v8f getViolin8(const v8f* phase, float resolution);
+V8_INLINE v8f aliased_sin8(const v8f* phase, float h, float offset); // of phase*h + offset
+
 // utility functions
 float Hz(float hz);
+float wrapPhase(float phase);
+V8_INLINE v8f wrapPhase8(const v8f* phase);
 float squish(float f);
 int fZero(float f);
-Sint8 quantise_float(float f);
+int blownUp(float f); // nan, inf or 2^32 and past, far beyond the 128 of full scale, where a patch has blown up
 
 // init
 int initMonoAudio(int samplerate);
 
+// conversion
+Uint32 sampleBytes(Uint32 format);
+void convertSamples(const float* in, void* out, Uint32 n, Uint32 format); // clipped, in is 8-bit scaled
+
+// loop points
+#define LOOP_MATCH 32       // samples compared either side of the seam
+#define LOOP_CANDIDATES 256 // zero crossings tried per region
+#define LOOP_SNAP 8         // resampled samples searched either side of a moved loop point
+Uint32 risingZeros(const float* in, Uint32 from, Uint32 to, Uint32* out, Uint32 max); // every i with in[i] < 0 <= in[i+1]
+float loopError(const float* in, Uint32 a, Uint32 b);
+int findLoop(const float* in, Uint32 len, Uint32* start, Uint32* end); // end inclusive, 0 when nothing crosses zero
+Uint32 crossingAt(const float* in, Uint32 i, Uint32 from, Uint32 to); // first sample at rate to on or past the crossing after in[i]
+Uint32 crossingNear(const struct sresample* r, const float* in, Uint32 len, Uint32 k); // the output nearest k with out[k-1] < 0 <= out[k]
+
 // file
-void writeWAV(const char* file);
+void writeWAV(const char* file, Uint32 format); // SAMPLE_U8, SAMPLE_S16 or SAMPLE_F32
+float* loadWAV(const char* file, Uint32 rate, Uint32* len); // mono, resampled to rate
+
+// streaming wav writer, the sizes are fixed up by wavClose
+struct swav
+{
+    FILE* f;
+    Uint32 format;
+    Uint32 rate;
+    Uint32 len;     // samples written
+    Uint8* buf;     // WAV_BUFFER bytes from arena
+    Uint32 fill;
+    struct sarena* arena;
+    size_t mark;
+    int err;
+};
+int wavOpen(struct swav* w, struct sarena* arena, const char* file, Uint32 format, Uint32 rate);
+int wavWrite(struct swav* w, const float* in, Uint32 n); // in is 8-bit scaled
+int wavClose(struct swav* w);
+
+// export file, wav in any sample format or flac, resampled when rate is not the render rate
+struct ssound
+{
+    Uint32 format;
+    struct swav wav;
+    struct sflac flac;
+    Uint8 resample;
+    struct sresample rs;
+    float* rsout;   // RESAMPLE_OUT samples from arena
+    struct sarena* arena;
+    size_t mark;
+};
+int soundOpen(struct ssound* s, struct sarena* arena, const char* file, Uint32 format, Uint32 rate, Uint32 quality);
+int soundWrite(struct ssound* s, const float* in, Uint32 n); // in is 8-bit scaled
+int soundPut(struct ssound* s, const float* in, Uint32 n);   // at the file rate
+int soundClose(struct ssound* s);
+Uint64 soundBytes(const struct ssound* s); // file size
 
 // play
 void setSampleLen(Uint32 seconds);
@@ -68,6 +150,23 @@ inline float aliased_cos(float theta)
     return aliased_sin(1.570796371f - theta);
 }
 
+V8_INLINE v8f aliased_sin8(const v8f* phase, float h, float offset)
+{
+    const v8f theta = *phase * h + offset;
+#ifdef __x86_64__
+    const v8i i = __builtin_convertvector(theta * 10430.37793f, v8i) & 0xFFFF;
+#ifdef __AVX2__
+    return (v8f)_mm256_i32gather_ps(sine_wtable, (__m256i)i, 4);
+#else
+    return (v8f){sine_wtable[i[0]], sine_wtable[i[1]], sine_wtable[i[2]], sine_wtable[i[3]],
+                 sine_wtable[i[4]], sine_wtable[i[5]], sine_wtable[i[6]], sine_wtable[i[7]]};
+#endif
+#else
+    return (v8f){sinf(theta[0]), sinf(theta[1]), sinf(theta[2]), sinf(theta[3]),
+                 sinf(theta[4]), sinf(theta[5]), sinf(theta[6]), sinf(theta[7])};
+#endif
+}
+
 // reciprocal tables
 #ifdef USE_RECIPROCAL_TABLES
     const float ht[] = {0.5f, 0.333333f, 0.25f, 0.2f, 0.166667f, 0.142857f, 0.125f, 0.111111f, 0.1f, 0.0909091f, 0.0833333f, 0.0769231f, 0.0714286f, 0.0666667f, 0.0625f, 0.0588235f, 0.0555556f, 0.0526316f, 0.05f, 0.047619f, 0.0454545f, 0.0434783f, 0.0416667f, 0.04f, 0.0384615f, 0.037037f, 0.0357143f, 0.0344828f, 0.0333333f, 0.0322581f, 0.03125f, 0.030303f, 0.0294118f, 0.0285714f, 0.0277778f, 0.027027f, 0.0263158f, 0.025641f, 0.025f, 0.0243902f, 0.0238095f, 0.0232558f, 0.0227273f, 0.0222222f, 0.0217391f, 0.0212766f, 0.0208333f, 0.0204082f, 0.02f, 0.0196078f, 0.0192308f, 0.0188679f, 0.0185185f, 0.0181818f, 0.0178571f, 0.0175439f, 0.0172414f, 0.0169492f};
@@ -141,6 +240,72 @@ inline float aliased_cos(float theta)
         }
         return yr;
     }
+
+    V8_INLINE v8f getSlantSine8(const v8f* phase, float resolution)
+    {
+        v8f yr = aliased_sin8(phase, 1.f, 0.f);
+        int i = 0;
+        for(float h = 3.f; h < resolution; h+=1.f)
+        {
+            yr += aliased_sin8(phase, h, 0.f) * hht[i];
+            i++;
+        }
+        return yr;
+    }
+
+    V8_INLINE v8f getSquare8(const v8f* phase, float resolution)
+    {
+        resolution *= 2.f;
+        v8f yr = aliased_sin8(phase, 1.f, 0.f);
+        int i = 1;
+        for(float h = 3.f; h < resolution; h+=2.f)
+        {
+            yr += aliased_sin8(phase, h, 0.f)*ht[i];
+            i+=2;
+        }
+        return yr;
+    }
+
+    V8_INLINE v8f getSawtooth8(const v8f* phase, float resolution)
+    {
+        v8f yr = aliased_sin8(phase, 1.f, 0.f);
+        int i = 0;
+        for(float h = 2.f; h <= resolution; h+=1.f)
+        {
+            yr += aliased_sin8(phase, h, 0.f)*ht[i];
+            i++;
+        }
+        return yr;
+    }
+
+    V8_INLINE v8f getTriangle8(const v8f* phase, float resolution)
+    {
+        resolution *= 2.f;
+        v8f yr = aliased_sin8(phase, 1.f, 0.f);
+        float sign = -1.f;
+        int i = 0;
+        for(float h = 3.f; h <= resolution; h+=2.f)
+        {
+            yr += aliased_sin8(phase, h, 0.f) * (hht[i] * sign);
+            sign *= -1.f;
+            i+=2;
+        }
+        return yr;
+    }
+
+    V8_INLINE v8f getBipulse8(const v8f* phase, float resolution) // formant
+    {
+        v8f yr = {0.f};
+        int i = 0;
+        for(float h = 1.f; h <= resolution; h+=1.f)
+        {
+            const float d = (h - 5.f) * 0.5f;
+            const float amp = expf(-d * d) * hhht[i];
+            yr += aliased_sin8(phase, h, 0.f) * amp;
+            i++;
+        }
+        return yr;
+    }
 #else
     float getSlantSine(float phase, float resolution)
     {
@@ -193,6 +358,56 @@ inline float aliased_cos(float theta)
         }
         return yr;
     }
+
+    V8_INLINE v8f getSlantSine8(const v8f* phase, float resolution)
+    {
+        v8f yr = aliased_sin8(phase, 1.f, 0.f);
+        for(float h = 3.f; h < resolution; h+=1.f)
+            yr += aliased_sin8(phase, h, 0.f) / (h*h);
+        return yr;
+    }
+
+    V8_INLINE v8f getSquare8(const v8f* phase, float resolution)
+    {
+        resolution *= 2.f;
+        v8f yr = aliased_sin8(phase, 1.f, 0.f);
+        for(float h = 3.f; h < resolution; h+=2.f)
+            yr += aliased_sin8(phase, h, 0.f)/h;
+        return yr;
+    }
+
+    V8_INLINE v8f getSawtooth8(const v8f* phase, float resolution)
+    {
+        v8f yr = aliased_sin8(phase, 1.f, 0.f);
+        for(float h = 2.f; h <= resolution; h+=1.f)
+            yr += aliased_sin8(phase, h, 0.f)/h;
+        return yr;
+    }
+
+    V8_INLINE v8f getTriangle8(const v8f* phase, float resolution)
+    {
+        resolution *= 2.f;
+        v8f yr = aliased_sin8(phase, 1.f, 0.f);
+        float sign = -1.f;
+        for(float h = 3.f; h <= resolution; h+=2.f)
+        {
+            yr += aliased_sin8(phase, h, 0.f) * (sign / (h*h));
+            sign *= -1.f;
+        }
+        return yr;
+    }
+
+    V8_INLINE v8f getBipulse8(const v8f* phase, float resolution) // formant
+    {
+        v8f yr = {0.f};
+        for(float h = 1.f; h <= resolution; h+=1.f)
+        {
+            const float d = (h - 5.f) * 0.5f;
+            const float amp = expf(-d * d) / h;
+            yr += aliased_sin8(phase, h, 0.f) * amp;
+        }
+        return yr;
+    }
 #endif
 
 const float vamps[10] = {0.5f,0.45f,0.4f,0.35f,0.3f,0.25f,0.2f,0.15f,0.1f,0.05f};
@@ -217,6 +432,27 @@ float getViolin(float phase, float resolution) // Band-limited Impulse
     return yr;
 }
 
+V8_INLINE v8f getViolin8(const v8f* phase, float resolution)
+{
+    v8f yr = {0.f};
+    for(int h = 0; h < 10; ++h)
+    {
+        const float step = h * 3.f;
+        if(resolution > step)
+        {
+            const float phaseOffset = (h % 2 == 0) ? 0.f : 1.57079632679f;
+            float amp = vamps[h];
+            if(resolution < step + 3.f)
+            {
+                float t = (resolution - step) * 0.33333333333333333333f;
+                amp *= t;
+            }
+            yr += aliased_sin8(phase, (float)(h + 1), phaseOffset) * amp;
+        }
+    }
+    return yr;
+}
+
 // --------------------------------------------- >
 
 inline float Hz(float hz)
@@ -224,6 +460,17 @@ inline float Hz(float hz)
     return hz * 6.283185482f;
 }
 
+inline float wrapPhase(float phase)
+{
+    // keeps accumulated phases within one cycle so they don't lose precision
+    return phase - (float)(int)(phase * 0.1591549367f) * 6.283185482f;
+}
+
+V8_INLINE v8f wrapPhase8(const v8f* phase)
+{
+    return *phase - __builtin_convertvector(__builtin_convertvector(*phase * 0.1591549367f, v8i), v8f) * 6.283185482f;
+}
+
 inline int fZero(float f)
 {
     return f > -0.01f && f < 0.01f ? 1.f : 0.f;
@@ -234,37 +481,203 @@ inline float squish(float f)
     return fabsf(tanhf(f));
 }
 
-inline Sint8 quantise_float(float f)
+inline int blownUp(float f)
 {
-    return roundf(f);
-    // if(f < 0.f)
-    //     f -= 0.5f;
-    // else
-    //     f += 0.5f;
-    // return (Sint8)f;
+    // on the exponent bits as -Ofast drops nan and inf tests
+    Uint32 u;
+    memcpy(&u, &f, 4);
+    return ((u >> 23) & 0xff) >= 127 + 32 ? 1 : 0;
 }
 
 // vars
-#define MAX_SAMPLE 1455300 //33*44100
+#define MAX_SAMPLE     1455300 //33*44100
+#define WAV_BUFFER     65536   // bytes per file write, the first one carries the header
+#define RENDER_SCRATCH (WAV_BUFFER + 4096) // bytes of arena kept for scratch buffers
+#define SOUND_BUFFER   ((FLAC_BUFFER > WAV_BUFFER ? FLAC_BUFFER : WAV_BUFFER) + RESAMPLE_BUFFER + RESAMPLE_OUT*sizeof(float) + ARENA_ALIGN) // arena bytes of soundOpen
 SDL_AudioSpec sdlaudioformat;
-Sint8 sample[MAX_SAMPLE];
+Uint32 device_format = SAMPLE_S16;
+struct sarena render_arena;
+float* sample = NULL; // render buffer, 8-bit scaled, in render_arena
 Uint32 sample_index = 0;
 Uint32 sample_len = 0;
 
-void audioCallback(void* unused, Uint8* stream, int len)
-{    
-    for(int i = 0; i < len; i++)
+Uint32 sampleBytes(Uint32 format)
+{
+    if(format == SAMPLE_S16 || format == SAMPLE_FLAC)
+        return 2;
+    else if(format == SAMPLE_F32)
+        return 4;
+    return 1;
+}
+
+void convertSamples(const float* in, void* out, Uint32 n, Uint32 format)
+{
+    // one fused scale, clip and round pass, 8 samples at a time
+    float scale = 1.f, lo = -128.f, hi = 127.f;
+    if(format == SAMPLE_S16)
+        scale = 256.f, lo = -32768.f, hi = 32767.f;
+    else if(format == SAMPLE_F32)
+        scale = 0.0078125f, lo = -1.f, hi = 1.f;
+    const v8f vlo = {lo, lo, lo, lo, lo, lo, lo, lo};
+    const v8f vhi = {hi, hi, hi, hi, hi, hi, hi, hi};
+    const v8i sign = {(int)0x80000000, (int)0x80000000, (int)0x80000000, (int)0x80000000, (int)0x80000000, (int)0x80000000, (int)0x80000000, (int)0x80000000};
+    const v8f half = {0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f};
+
+    Uint32 i = 0;
+    for(; i + 8 <= n; i += 8)
     {
-        if(sample_index >= sample_len)
+        v8f x;
+        memcpy(&x, &in[i], sizeof(v8f));
+        x *= scale;
+        v8i m = x < vlo;
+        x = (v8f)((m & (v8i)vlo) | (~m & (v8i)x));
+        m = x > vhi;
+        x = (v8f)((m & (v8i)vhi) | (~m & (v8i)x));
+        if(format == SAMPLE_F32)
+        {
+            memcpy(&((float*)out)[i], &x, sizeof(v8f));
+            continue;
+        }
+
+        // round half away from zero like roundf
+        v8i q = __builtin_convertvector(x + (v8f)(((v8i)x & sign) | (v8i)half), v8i);
+        if(format == SAMPLE_S16)
+        {
+            const v8s16 s = __builtin_convertvector(q, v8s16);
+            memcpy(&((Sint16*)out)[i], &s, sizeof(v8s16));
+        }
+        else
         {
-            stream[i] = 0;
-            SDL_PauseAudio(1);
+            if(format == SAMPLE_U8)
+                q += 128;
+            const v8s8 s = __builtin_convertvector(q, v8s8);
+            memcpy(&((Sint8*)out)[i], &s, sizeof(v8s8));
+        }
+    }
+
+    for(; i < n; i++)
+    {
+        float x = in[i] * scale;
+        if(x < lo)
+            x = lo;
+        else if(x > hi)
+            x = hi;
+        if(format == SAMPLE_F32)
+            ((float*)out)[i] = x;
+        else if(format == SAMPLE_S16)
+            ((Sint16*)out)[i] = roundf(x);
+        else if(format == SAMPLE_U8)
+            ((Uint8*)out)[i] = (int)roundf(x) + 128;
+        else
+            ((Sint8*)out)[i] = roundf(x);
+    }
+}
+
+Uint32 risingZeros(const float* in, Uint32 from, Uint32 to, Uint32* out, Uint32 max)
+{
+    // 8 pairs per compare, blocks without a crossing are skipped whole
+    const v8f zero = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+    Uint32 n = 0, i = from;
+    for(; i + 9 <= to && n < max; i += 8)
+    {
+        v8f a, b;
+        memcpy(&a, &in[i], sizeof(v8f));
+        memcpy(&b, &in[i+1], sizeof(v8f));
+        const v8i m = (a < zero) & (b >= zero);
+        Uint64 any[4];
+        memcpy(any, &m, sizeof(v8i));
+        if((any[0] | any[1] | any[2] | any[3]) == 0)
             continue;
+        for(int j = 0; j < 8 && n < max; j++)
+            if(m[j] != 0)
+                out[n++] = i + j;
+    }
+    for(; i + 1 < to && n < max; i++)
+        if(in[i] < 0.f && in[i+1] >= 0.f)
+            out[n++] = i;
+    return n;
+}
+
+float loopError(const float* in, Uint32 a, Uint32 b)
+{
+    // squared difference around two seam points
+    v8f d = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+    for(Uint32 k = 0; k < LOOP_MATCH*2; k += 8)
+    {
+        v8f x, y;
+        memcpy(&x, &in[a-LOOP_MATCH+k], sizeof(v8f));
+        memcpy(&y, &in[b-LOOP_MATCH+k], sizeof(v8f));
+        x -= y;
+        d += x * x;
+    }
+    return d[0] + d[1] + d[2] + d[3] + d[4] + d[5] + d[6] + d[7];
+}
+
+int findLoop(const float* in, Uint32 len, Uint32* start, Uint32* end)
+{
+    // start in the second quarter, end in the last, both on a rising
+    // zero crossing, the pair whose waveforms match best around the seam
+    if(len < LOOP_MATCH*16)
+        return 0;
+    Uint32 s[LOOP_CANDIDATES], e[LOOP_CANDIDATES];
+    const Uint32 ns = risingZeros(in, len/4, len/2, s, LOOP_CANDIDATES);
+    Uint32 ne = 0, from = len - LOOP_MATCH - 1;
+    while(ne == 0 && from > len*3/4)
+    {
+        // the last crossings before the end
+        from = from > len*3/4 + LOOP_MATCH*64 ? from - LOOP_MATCH*64 : len*3/4;
+        ne = risingZeros(in, from, len - LOOP_MATCH - 1, e, LOOP_CANDIDATES);
+    }
+    if(ns == 0 || ne == 0)
+        return 0;
+
+    float best = INFINITY;
+    for(Uint32 i = 0; i < ns; i++)
+    {
+        for(Uint32 j = 0; j < ne; j++)
+        {
+            const float d = loopError(in, s[i]+1, e[j]+1);
+            if(d < best)
+                best = d, *start = s[i]+1, *end = e[j];
         }
+    }
+    return 1;
+}
+
+Uint32 crossingAt(const float* in, Uint32 i, Uint32 from, Uint32 to)
+{
+    // the crossing sits a fraction of a sample past i, the resampler puts output k at input k*from/to
+    const double d = (double)in[i+1] - (double)in[i];
+    const double t = i + (d > 0.0 ? -in[i] / d : 0.0);
+    return ceil(t * to / from);
+}
 
-        stream[i] = sample[sample_index];
-        sample_index++;
+Uint32 crossingNear(const struct sresample* r, const float* in, Uint32 len, Uint32 k)
+{
+    // the filter rings around clipped samples, so the crossing is looked for in what is written
+    for(Uint32 d = 0; d <= LOOP_SNAP; d++)
+    {
+        if(k + d >= 1 && resampleAt(r, in, len, k + d - 1) < 0.f && resampleAt(r, in, len, k + d) >= 0.f)
+            return k + d;
+        if(d > 0 && k >= d + 1 && resampleAt(r, in, len, k - d - 1) < 0.f && resampleAt(r, in, len, k - d) >= 0.f)
+            return k - d;
     }
+    return k;
+}
+
+void audioCallback(void* unused, Uint8* stream, int len)
+{
+    const Uint32 b = sampleBytes(device_format);
+    Uint32 n = len / b;
+    Uint32 left = sample_index < sample_len ? sample_len - sample_index : 0;
+    if(n > left)
+    {
+        memset(stream + left*b, device_format == SAMPLE_U8 ? 128 : 0, (n - left)*b);
+        n = left;
+        SDL_PauseAudio(1);
+    }
+    convertSamples(&sample[sample_index], stream, n, device_format);
+    sample_index += n;
 }
 
 void playSample()
@@ -284,17 +697,28 @@ void setSampleLen(Uint32 seconds)
     sample_len = sdlaudioformat.freq * seconds;
     if(sample_len > MAX_SAMPLE)
         sample_len = MAX_SAMPLE;
+
+    // the arena is sized to this bank, the callback must not read while it moves
+    SDL_LockAudio();
+    sample = NULL;
+    if(arenaReset(&render_arena, sample_len*sizeof(float) + RENDER_SCRATCH) == 1)
+        sample = arenaAlloc(&render_arena, sample_len*sizeof(float));
+    if(sample == NULL)
+        sample_len = 0;
+    sample_index = sample_len;
+    SDL_UnlockAudio();
 }
 
 int initMonoAudio(int samplerate)
 {
-    // set audio format
+    // set audio format, SDL converts if the device wants something else
     sdlaudioformat.freq = samplerate; // 44100 / 48000
-    sdlaudioformat.format = AUDIO_S8; // AUDIO_S16
+    sdlaudioformat.format = AUDIO_S16SYS; // AUDIO_S8
     sdlaudioformat.channels = 1;
     sdlaudioformat.samples = 4096;
     sdlaudioformat.callback = audioCallback;
     sdlaudioformat.userdata = NULL;
+    device_format = SAMPLE_S16;
 
     // open audio device
     if(SDL_OpenAudio(&sdlaudioformat, 0) < 0)
@@ -310,43 +734,320 @@ int initMonoAudio(int samplerate)
     return 1;
 }
 
-void writeWAV(const char* file)
-{
-    // I have to convert the buffer to unsigned, madness.
-    Uint8 usample[MAX_SAMPLE];
-    for(int i = 0; i < sample_len; i++)
-        usample[i] = sample[i]+128;
-
-    // prep header
-    const unsigned int wavedata_size = sample_len + 44;
-    const unsigned int subchunk = 16;
-    const unsigned short audioformat = 1;
-    const unsigned short channels = 1;
-    const unsigned int samplerate = sdlaudioformat.freq;
-    const unsigned short bitspersample = 8;
-    const unsigned int byterate = (samplerate * channels * bitspersample) / 8;
-    const unsigned short blockalignment = (channels * bitspersample) / 8;
-
-    // write wav
-    FILE* f = fopen(file, "wb");
-    if(f != NULL)
-    {
-        fwrite("RIFF", 4, 1, f);
-        fwrite(&wavedata_size, 4, 1, f);
-        fwrite("WAVE", 4, 1, f);
-        fwrite("fmt ", 4, 1, f);
-        fwrite(&subchunk, 4, 1, f);
-        fwrite(&audioformat, 2, 1, f);
-        fwrite(&channels, 2, 1, f);
-        fwrite(&samplerate, 4, 1, f);
-        fwrite(&byterate, 4, 1, f);
-        fwrite(&blockalignment, 2, 1, f);
-        fwrite(&bitspersample, 2, 1, f);
-        fwrite("data", 4, 1, f);
-        fwrite(&sample_len, 4, 1, f);
-        fwrite(usample, sample_len, 1, f);
+void wavHeader(Uint8* h, Uint32 format, Uint32 len, Uint32 rate)
+{
+    // 44 bytes, an odd data chunk is followed by a pad byte
+    const Uint32 datasize = len * sampleBytes(format);
+    const Uint32 riffsize = 36 + datasize + (datasize & 1);
+    const Uint32 subchunk = 16;
+    const Uint16 audioformat = format == SAMPLE_F32 ? 3 : 1;
+    const Uint16 channels = 1;
+    const Uint32 samplerate = rate;
+    const Uint16 bitspersample = sampleBytes(format) * 8;
+    const Uint32 byterate = (samplerate * channels * bitspersample) / 8;
+    const Uint16 blockalignment = (channels * bitspersample) / 8;
+
+    memcpy(h, "RIFF", 4);
+    memcpy(h+4, &riffsize, 4);
+    memcpy(h+8, "WAVE", 4);
+    memcpy(h+12, "fmt ", 4);
+    memcpy(h+16, &subchunk, 4);
+    memcpy(h+20, &audioformat, 2);
+    memcpy(h+22, &channels, 2);
+    memcpy(h+24, &samplerate, 4);
+    memcpy(h+28, &byterate, 4);
+    memcpy(h+32, &blockalignment, 2);
+    memcpy(h+34, &bitspersample, 2);
+    memcpy(h+36, "data", 4);
+    memcpy(h+40, &datasize, 4);
+}
+
+int wavOpen(struct swav* w, struct sarena* arena, const char* file, Uint32 format, Uint32 rate)
+{
+    memset(w, 0x00, sizeof(struct swav));
+    w->format = format;
+    w->rate = rate;
+    w->arena = arena;
+    w->mark = arenaMark(arena);
+    w->buf = arenaAlloc(arena, WAV_BUFFER);
+    if(w->buf == NULL)
+        return -1;
+    w->f = fopen(file, "wb");
+    if(w->f == NULL)
+    {
+        arenaRelease(arena, w->mark);
+        return -1;
+    }
+
+    // whole buffers are written at WAV_BUFFER aligned offsets, stdio would only copy them
+    setvbuf(w->f, NULL, _IONBF, 0);
+    wavHeader(w->buf, format, 0, rate);
+    w->fill = 44;
+    return 1;
+}
+
+int wavWrite(struct swav* w, const float* in, Uint32 n)
+{
+    const Uint32 b = sampleBytes(w->format);
+    if(((Uint64)w->len + n) * b + 44 > 0xFFFFFFFF)
+        w->err = -1;
+    while(n > 0 && w->err == 0)
+    {
+        Uint32 c = (WAV_BUFFER - w->fill) / b;
+        if(c > n)
+            c = n;
+        convertSamples(in, w->buf + w->fill, c, w->format);
+        w->fill += c * b;
+        w->len += c;
+        in += c;
+        n -= c;
+        if(w->fill + b > WAV_BUFFER)
+        {
+            if(fwrite(w->buf, w->fill, 1, w->f) != 1)
+                w->err = -1;
+            w->fill = 0;
+        }
+    }
+    return w->err == 0 ? 1 : -1;
+}
+
+int wavClose(struct swav* w)
+{
+    // flush with the pad byte, then put the real sizes in the header
+    if(w->err == 0 && (w->len * sampleBytes(w->format)) % 2 == 1)
+        w->buf[w->fill++] = 0;
+    if(w->err == 0 && w->fill > 0 && fwrite(w->buf, w->fill, 1, w->f) != 1)
+        w->err = -1;
+    if(w->err == 0)
+    {
+        wavHeader(w->buf, w->format, w->len, w->rate);
+        if(fseek(w->f, 0, SEEK_SET) != 0 || fwrite(w->buf, 44, 1, w->f) != 1)
+            w->err = -1;
+    }
+    if(fclose(w->f) != 0)
+        w->err = -1;
+    arenaRelease(w->arena, w->mark);
+    return w->err == 0 ? 1 : -1;
+}
+
+void writeWAV(const char* file, Uint32 format)
+{
+    struct swav w;
+    if(wavOpen(&w, &render_arena, file, format, sdlaudioformat.freq) < 0)
+        return;
+    wavWrite(&w, sample, sample_len);
+    wavClose(&w);
+}
+
+int soundOpen(struct ssound* s, struct sarena* arena, const char* file, Uint32 format, Uint32 rate, Uint32 quality)
+{
+    s->format = format;
+    s->resample = 0;
+    s->arena = arena;
+    s->mark = arenaMark(arena);
+    if(rate == 0)
+        rate = sdlaudioformat.freq;
+    if(rate != sdlaudioformat.freq)
+    {
+        s->rsout = arenaAlloc(arena, RESAMPLE_OUT*sizeof(float));
+        if(s->rsout == NULL || resampleInit(&s->rs, arena, sdlaudioformat.freq, rate, quality) < 0)
+        {
+            arenaRelease(arena, s->mark);
+            return -1;
+        }
+        s->resample = 1;
+    }
+
+    int r;
+    if(format == SAMPLE_FLAC)
+        r = flacOpen(&s->flac, arena, file, rate);
+    else
+        r = wavOpen(&s->wav, arena, file, format, rate);
+    if(r < 0)
+        arenaRelease(arena, s->mark);
+    return r;
+}
+
+int soundPut(struct ssound* s, const float* in, Uint32 n)
+{
+    if(s->format != SAMPLE_FLAC)
+        return wavWrite(&s->wav, in, n);
+
+    // the same clip and round as a 16-bit wav
+    Sint16 pcm[1024];
+    while(n > 0)
+    {
+        const Uint32 c = n < 1024 ? n : 1024;
+        convertSamples(in, pcm, c, SAMPLE_S16);
+        if(flacWrite(&s->flac, pcm, c) < 0)
+            return -1;
+        in += c;
+        n -= c;
+    }
+    return 1;
+}
+
+int soundWrite(struct ssound* s, const float* in, Uint32 n)
+{
+    if(s->resample == 0)
+        return soundPut(s, in, n);
+    while(n > 0)
+    {
+        const Uint32 c = n < RESAMPLE_BLOCK ? n : RESAMPLE_BLOCK;
+        if(soundPut(s, s->rsout, resampleRun(&s->rs, in, c, s->rsout)) < 0)
+            return -1;
+        in += c;
+        n -= c;
+    }
+    return 1;
+}
+
+int soundClose(struct ssound* s)
+{
+    // a failed write of the resampler's tail fails the file too
+    const int flushed = s->resample == 1 ? soundPut(s, s->rsout, resampleFlush(&s->rs, s->rsout)) : 1;
+    int r;
+    if(s->format == SAMPLE_FLAC)
+        r = flacClose(&s->flac);
+    else
+        r = wavClose(&s->wav);
+    if(flushed < 0)
+        r = -1;
+    arenaRelease(s->arena, s->mark);
+    return r;
+}
+
+Uint64 soundBytes(const struct ssound* s)
+{
+    if(s->format == SAMPLE_FLAC)
+        return s->flac.bytes;
+    const Uint64 d = (Uint64)s->wav.len * sampleBytes(s->format);
+    return 44 + d + (d & 1);
+}
+
+float* loadWAV(const char* file, Uint32 rate, Uint32* len)
+{
+    FILE* f = fopen(file, "rb");
+    if(f == NULL)
+        return NULL;
+
+    char id[4];
+    Uint32 size = 0;
+    if(fread(id, 4, 1, f) != 1 || memcmp(id, "RIFF", 4) != 0 ||
+       fread(&size, 4, 1, f) != 1 ||
+       fread(id, 4, 1, f) != 1 || memcmp(id, "WAVE", 4) != 0)
+    {
         fclose(f);
+        return NULL;
+    }
+
+    // walk the chunks for the format and the data
+    unsigned short format = 0, channels = 0, bitspersample = 0;
+    unsigned int samplerate = 0;
+    Uint8* data = NULL;
+    while(fread(id, 4, 1, f) == 1 && fread(&size, 4, 1, f) == 1)
+    {
+        if(memcmp(id, "fmt ", 4) == 0 && size >= 16)
+        {
+            Uint8 fmt[40] = {0};
+            if(fread(fmt, size < 40 ? size : 40, 1, f) != 1)
+                break;
+            if(size > 40)
+                fseek(f, size - 40, SEEK_CUR);
+            memcpy(&format, &fmt[0], 2);
+            memcpy(&channels, &fmt[2], 2);
+            memcpy(&samplerate, &fmt[4], 4);
+            memcpy(&bitspersample, &fmt[14], 2);
+            if(format == 0xFFFE && size >= 26) // extensible, sub format follows
+                memcpy(&format, &fmt[24], 2);
+        }
+        else if(memcmp(id, "data", 4) == 0)
+        {
+            data = malloc(size);
+            if(data != NULL && fread(data, size, 1, f) != 1)
+            {
+                free(data);
+                data = NULL;
+            }
+            break;
+        }
+        else
+        {
+            fseek(f, size + (size & 1), SEEK_CUR);
+        }
+    }
+    fclose(f);
+
+    const Uint32 bytes = bitspersample / 8;
+    if(data == NULL || channels == 0 || samplerate == 0 || bytes == 0 ||
+       (format == 1 && bytes > 4) || (format == 3 && bytes != 4) || (format != 1 && format != 3))
+    {
+        free(data);
+        return NULL;
+    }
+
+    // mix down to mono float
+    const Uint32 frames = size / (bytes * channels);
+    float* mono = malloc((frames+1) * sizeof(float));
+    if(mono == NULL)
+    {
+        free(data);
+        return NULL;
+    }
+    for(Uint32 i = 0; i < frames; i++)
+    {
+        float v = 0.f;
+        for(Uint32 c = 0; c < channels; c++)
+        {
+            const Uint8* p = &data[(i*channels + c) * bytes];
+            if(format == 3)
+            {
+                float x;
+                memcpy(&x, p, 4);
+                v += x;
+            }
+            else if(bytes == 1)
+            {
+                v += ((float)p[0] - 128.f) * 0.0078125f;
+            }
+            else
+            {
+                // sign extend the top bytes of any 16/24/32 bit sample
+                Sint32 x = 0;
+                memcpy(((Uint8*)&x) + (4-bytes), p, bytes);
+                v += (float)x * 4.656612873e-10f; // 1/2^31
+            }
+        }
+        mono[i] = v / (float)channels;
     }
+    free(data);
+    mono[frames] = 0.f;
+
+    // linear resample
+    if(samplerate != rate && frames > 1)
+    {
+        const double step = (double)samplerate / (double)rate;
+        const Uint32 rlen = (Uint32)((double)(frames-1) / step) + 1;
+        float* r = malloc(rlen * sizeof(float));
+        if(r == NULL)
+        {
+            free(mono);
+            return NULL;
+        }
+        for(Uint32 i = 0; i < rlen; i++)
+        {
+            const double p = (double)i * step;
+            const Uint32 j = (Uint32)p;
+            const float fr = (float)(p - (double)j);
+            r[i] = mono[j] + (mono[j+1] - mono[j]) * fr;
+        }
+        free(mono);
+        *len = rlen;
+        return r;
+    }
+
+    *len = frames;
+    return mono;
 }
 
 #endif
@@ -0,0 +1,19 @@
+/*
+    Borg ER-3
+
+    8 lane vectors (GNU C vector extensions) shared by the
+    unison stacks, the FFT, the resampler and the similar
+    bank search. Loads from float arrays go through memcpy
+    as those are only float aligned.
+*/
+#ifndef VEC_H
+#define VEC_H
+
+#include <SDL2/SDL.h>
+
+typedef float v8f __attribute__ ((vector_size (32)));
+typedef int   v8i __attribute__ ((vector_size (32)));
+typedef Sint16 v8s16 __attribute__ ((vector_size (16)));
+typedef Sint8  v8s8 __attribute__ ((vector_size (8)));
+
+#endif